@@ -0,0 +1,189 @@
+#!/usr/bin/env python3
+"""Time llvm-reduce with each interestingness script over a fixed corpus.
+
+Every script is run on every input of the corpus it finds interesting, as
+the test of one llvm-reduce run. The test is wrapped in timing_shim.py, which
+logs each call, and one CSV row is written per reduction:
+
+  script,input,calls,interesting,median_ms,p99_ms,total_s,input_bytes,
+  reduced_bytes
+
+calls counts every run of the test, including the one llvm-reduce starts
+with, and the latencies are from the shim, so they leave out the startup of
+the shim's own interpreter. total_s is the wall time of the whole reduction.
+Inputs a script does not find interesting are skipped.
+
+Scripts that read BUGGY_ORACLE_SOCKET get a buggy-oracle of their own for
+each reduction, started the way reduce-with-oracle.sh does it and counted in
+total_s.
+
+Usage:
+  bench_reduce.py --llvm-reduce=llvm-reduce --corpus=bench/corpus \\
+      -o bench-reduce.csv interestingness.sh interestingness-O2.sh ...
+"""
+
+import argparse
+import csv
+import glob
+import math
+import os
+import statistics
+import subprocess
+import sys
+import tempfile
+import time
+
+SHIM = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                    'timing_shim.py')
+
+
+def is_interesting(script, path, env):
+    return subprocess.call([script, path],
+                           stdout=subprocess.DEVNULL,
+                           stderr=subprocess.DEVNULL,
+                           env=env) == 0
+
+
+def needs_oracle(script):
+    with open(script, errors='replace') as f:
+        return 'BUGGY_ORACLE_SOCKET' in f.read()
+
+
+def start_oracle(args, socket):
+    proc = subprocess.Popen([args.oracle, '--socket=' + socket] +
+                            args.oracle_arg)
+    while not os.path.exists(socket):
+        if proc.poll() is not None:
+            raise RuntimeError('buggy-oracle exited with status %d' %
+                               proc.returncode)
+        time.sleep(0.01)
+    return proc
+
+
+def percentile(sorted_values, p):
+    """Nearest-rank percentile of an already sorted list."""
+    rank = max(math.ceil(p / 100 * len(sorted_values)), 1)
+    return sorted_values[rank - 1]
+
+
+def bench(args, script, path, scratch):
+    """Reduce path with script, returning the CSV row or None to skip."""
+    env = dict(os.environ)
+    oracle = None
+    oracle_startup = 0
+    if needs_oracle(script):
+        if not args.oracle:
+            print('%s: no --oracle given, skipping' % script, file=sys.stderr)
+            return None
+        env['BUGGY_ORACLE_SOCKET'] = os.path.join(scratch, 'oracle.sock')
+        start = time.perf_counter()
+        oracle = start_oracle(args, env['BUGGY_ORACLE_SOCKET'])
+        oracle_startup = time.perf_counter() - start
+
+    try:
+        if not is_interesting(script, path, env):
+            print('%s: %s is not interesting, skipping' %
+                  (os.path.basename(script), os.path.basename(path)),
+                  file=sys.stderr)
+            return None
+
+        log = os.path.join(scratch, 'calls.log')
+        output = os.path.join(scratch, 'reduced' + os.path.splitext(path)[1])
+        cmd = [
+            args.llvm_reduce, '-j', str(args.jobs),
+            '--test=' + sys.executable, '--test-arg=' + SHIM,
+            '--test-arg=' + log, '--test-arg=' + script, '-o', output, path
+        ]
+        start = time.perf_counter()
+        status = subprocess.call(cmd,
+                                 stdout=subprocess.DEVNULL,
+                                 stderr=subprocess.DEVNULL,
+                                 env=env)
+        total = time.perf_counter() - start + oracle_startup
+    finally:
+        if oracle is not None:
+            oracle.terminate()
+            oracle.wait()
+
+    if status != 0:
+        print('%s: llvm-reduce failed on %s with status %d' %
+              (os.path.basename(script), os.path.basename(path), status),
+              file=sys.stderr)
+        return None
+
+    calls = []
+    with open(log) as f:
+        for line in f:
+            call_status, seconds = line.split()
+            calls.append((int(call_status), float(seconds)))
+    latencies = sorted(seconds for _, seconds in calls)
+
+    return [
+        os.path.basename(script),
+        os.path.basename(path),
+        len(calls),
+        sum(1 for call_status, _ in calls if call_status == 0),
+        '%.3f' % (statistics.median(latencies) * 1000),
+        '%.3f' % (percentile(latencies, 99) * 1000),
+        '%.3f' % total,
+        os.path.getsize(path),
+        os.path.getsize(output),
+    ]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument('scripts', nargs='+', metavar='script',
+                        help='Interestingness scripts to time')
+    parser.add_argument('--llvm-reduce', required=True,
+                        help='Path to llvm-reduce')
+    parser.add_argument('--corpus', required=True,
+                        help='Directory of .ll and .bc inputs')
+    parser.add_argument('-o', '--output', default='-',
+                        help='Write the CSV here instead of stdout')
+    parser.add_argument('-j', '--jobs', type=int, default=1,
+                        help='llvm-reduce jobs; more than 1 makes the call '
+                        'counts depend on scheduling')
+    parser.add_argument('--oracle',
+                        help='Path to buggy-oracle, for scripts using one')
+    parser.add_argument('--oracle-arg', action='append', default=[],
+                        help='Argument for buggy-oracle besides --socket')
+    args = parser.parse_args()
+
+    inputs = sorted(
+        glob.glob(os.path.join(args.corpus, '*.ll')) +
+        glob.glob(os.path.join(args.corpus, '*.bc')))
+    if not inputs:
+        print('No inputs in %s' % args.corpus, file=sys.stderr)
+        return 1
+
+    rows = []
+    for script in args.scripts:
+        if not os.path.exists(script):
+            print('%s: not generated, skipping' % script, file=sys.stderr)
+            continue
+        script = os.path.abspath(script)
+        for path in inputs:
+            with tempfile.TemporaryDirectory() as scratch:
+                row = bench(args, script, os.path.abspath(path), scratch)
+            if row is not None:
+                print('  %s %s: %s calls, %.1fs' %
+                      (row[0], row[1], row[2], float(row[6])),
+                      file=sys.stderr)
+                rows.append(row)
+
+    out = sys.stdout if args.output == '-' else open(args.output, 'w',
+                                                     newline='')
+    writer = csv.writer(out)
+    writer.writerow([
+        'script', 'input', 'calls', 'interesting', 'median_ms', 'p99_ms',
+        'total_s', 'input_bytes', 'reduced_bytes'
+    ])
+    writer.writerows(rows)
+    if out is not sys.stdout:
+        out.close()
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,48 @@
+; An i1 select and a PHI with a repeated predecessor in internal functions,
+; for the multi-crash tests. The select is reached first, so the filtered
+; tests see "i1 typed select is broken". The external function has an i1
+; select of its own, which bug-only-if-internal-func rules out.
+
+define i1 @either(i1 %a, i1 %b, i1 %c) {
+entry:
+  %s = select i1 %a, i1 %b, i1 %c
+  ret i1 %s
+}
+
+define internal i1 @pick(i32 %x, i32 %y, i1 %flag) {
+entry:
+  %lt = icmp ult i32 %x, %y
+  %eq = icmp eq i32 %x, 0
+  %sum = add i32 %x, %y
+  %big = icmp ugt i32 %sum, 100
+  %s = select i1 %flag, i1 %lt, i1 %eq
+  %r = xor i1 %s, %big
+  ret i1 %r
+}
+
+define internal i32 @dispatch(i32 %k, i32 %a, i32 %b) {
+entry:
+  switch i32 %k, label %other [
+    i32 0, label %join
+    i32 1, label %join
+  ]
+
+other:
+  %m = mul i32 %a, %b
+  br label %join
+
+join:
+  %r = phi i32 [ %a, %entry ], [ %a, %entry ], [ %m, %other ]
+  ret i32 %r
+}
+
+define i32 @driver(i32 %x, i32 %y) {
+entry:
+  %p = call i1 @pick(i32 %x, i32 %y, i1 true)
+  %k = zext i1 %p to i32
+  %d = call i32 @dispatch(i32 %k, i32 %x, i32 %y)
+  %e = call i1 @either(i1 %p, i1 false, i1 true)
+  %f = zext i1 %e to i32
+  %r = add i32 %d, %f
+  ret i32 %r
+}
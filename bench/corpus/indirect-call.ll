@@ -0,0 +1,23 @@
+; An indirect call, for infloop-on-indirect-call.
+
+define i32 @square(i32 %x) {
+entry:
+  %r = mul i32 %x, %x
+  ret i32 %r
+}
+
+define i32 @apply(ptr %fn, i32 %x) {
+entry:
+  %direct = call i32 @square(i32 %x)
+  %inc = add i32 %direct, 1
+  %r = call i32 %fn(i32 %inc)
+  %s = sub i32 %r, %x
+  ret i32 %s
+}
+
+define i32 @twice(ptr %fn, i32 %x) {
+entry:
+  %a = call i32 @apply(ptr %fn, i32 %x)
+  %b = call i32 @apply(ptr %fn, i32 %a)
+  ret i32 %b
+}
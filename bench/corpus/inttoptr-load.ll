@@ -0,0 +1,68 @@
+; Loads through an inttoptr, for crash-load-of-inttoptr. The functions
+; around it give llvm-reduce something to remove.
+
+@table = internal global [8 x i32] [i32 1, i32 2, i32 3, i32 4, i32 5, i32 6, i32 7, i32 8]
+
+define i32 @sum(ptr %a, i32 %n) {
+entry:
+  %empty = icmp sle i32 %n, 0
+  br i1 %empty, label %exit, label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %acc = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  %idx = sext i32 %i to i64
+  %gep = getelementptr inbounds i32, ptr %a, i64 %idx
+  %v = load i32, ptr %gep
+  %acc.next = add i32 %acc, %v
+  %i.next = add nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  %r = phi i32 [ 0, %entry ], [ %acc.next, %loop ]
+  ret i32 %r
+}
+
+define i32 @lookup(i64 %addr, i32 %k) {
+entry:
+  %base = call i32 @sum(ptr @table, i32 8)
+  %scaled = mul i32 %k, 3
+  %masked = and i32 %scaled, 7
+  %idx = zext i32 %masked to i64
+  %gep = getelementptr inbounds [8 x i32], ptr @table, i64 0, i64 %idx
+  %t = load i32, ptr %gep
+  %p = inttoptr i64 %addr to ptr
+  %v = load i32, ptr %p
+  %x = xor i32 %v, %t
+  %y = add i32 %x, %base
+  ret i32 %y
+}
+
+define i32 @clamp(i32 %x, i32 %lo, i32 %hi) {
+entry:
+  %below = icmp slt i32 %x, %lo
+  %lo.x = select i1 %below, i32 %lo, i32 %x
+  %above = icmp sgt i32 %lo.x, %hi
+  %r = select i1 %above, i32 %hi, i32 %lo.x
+  ret i32 %r
+}
+
+define void @fill(ptr %a, i32 %n, i32 %v) {
+entry:
+  %empty = icmp sle i32 %n, 0
+  br i1 %empty, label %exit, label %loop
+
+loop:
+  %i = phi i32 [ 0, %entry ], [ %i.next, %loop ]
+  %idx = sext i32 %i to i64
+  %gep = getelementptr inbounds i32, ptr %a, i64 %idx
+  %c = call i32 @clamp(i32 %v, i32 0, i32 255)
+  store i32 %c, ptr %gep
+  %i.next = add nsw i32 %i, 1
+  %done = icmp eq i32 %i.next, %n
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret void
+}
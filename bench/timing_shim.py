@@ -0,0 +1,37 @@
+#!/usr/bin/env python3
+"""Run an interestingness test and log how long it took.
+
+Usage:
+  timing_shim.py <log> <test> [test arguments]
+
+Runs the test with its arguments and exits with its status. One line with
+the status and the wall time in seconds is appended to log for every call,
+in a single write, so the calls of llvm-reduce -j can share a log.
+"""
+
+import os
+import subprocess
+import sys
+import time
+
+
+def main():
+    if len(sys.argv) < 3:
+        print(__doc__.strip(), file=sys.stderr)
+        return 2
+    log, cmd = sys.argv[1], sys.argv[2:]
+
+    start = time.perf_counter()
+    status = subprocess.call(cmd)
+    elapsed = time.perf_counter() - start
+
+    fd = os.open(log, os.O_WRONLY | os.O_APPEND | os.O_CREAT, 0o644)
+    try:
+        os.write(fd, ('%d %.9f\n' % (status, elapsed)).encode())
+    finally:
+        os.close(fd)
+    return status
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -6,146 +6,1563 @@
 //
 //===----------------------------------------------------------------------===//
 
+#include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/ADT/Statistic.h"
+#include "llvm/ADT/bit.h"
+#include "llvm/Analysis/OptimizationRemarkEmitter.h"
+#include "llvm/IR/CFG.h"
+#include "llvm/IR/InlineAsm.h"
+#include "llvm/IR/InstIterator.h"
+#include "llvm/IR/Instructions.h"
 #include "llvm/IR/PassManager.h"
+#include "llvm/IR/PassTimingInfo.h"
+#include "llvm/IR/StructuralHash.h"
 #include "llvm/Pass.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
 #include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Path.h"
 #include "llvm/Support/Process.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/TimeProfiler.h"
+#include "llvm/Support/Timer.h"
+#include "llvm/Support/xxhash.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 using namespace llvm;
 
+#define DEBUG_TYPE "buggy"
+
+STATISTIC(NumFunctionsChecked, "Number of functions checked");
+STATISTIC(NumSkippedByLinkage,
+          "Number of functions skipped by the linkage gates");
+STATISTIC(NumSkippedByOddGate,
+          "Number of functions skipped by the odd-number gate");
+STATISTIC(NumWalksSkipped, "Number of instruction walks skipped by probing");
+STATISTIC(NumInstsWalked, "Number of instructions walked");
+STATISTIC(NumCachedVerdicts, "Number of functions skipped by the verdict cache");
+#define BUGGY_OPTION(Field, Name)
+#define BUGGY_CHECK_OPTION(Field, Name, Check)                                 \
+  STATISTIC(NumVisited##Check, "Number of instructions visited by " Name);
+#define BUGGY_BUG_CHECK_OPTION(Field, Name, Bug)                               \
+  BUGGY_CHECK_OPTION(Field, Name, Bug)
+#include "BuggyOptions.def"
+
 namespace {
+/// Bit positions of the boolean options in BuggyOptions::Flags.
+enum BuggyOptionBit : unsigned {
+#define BUGGY_OPTION(Field, Name) BuggyOptionBit##Field,
+#include "BuggyOptions.def"
+  NumBuggyOptionBits
+};
+static_assert(NumBuggyOptionBits <= 64, "BuggyOptions::Flags is too small");
+
 struct BuggyOptions {
-  bool CrashOnVector = false;
-  bool CrashOnShuffleVector = false;
-  bool CrashOnLoadOfIntToPtr = false;
-  bool CrashOnStoreToConstantExpr = false;
-  bool CrashOnAggregatePhi = false;
-  bool CrashOnPhiRepeatedPredecessor = false;
-  bool CrashOnPhiSelfReference = false;
-  bool CrashOnSwitchOddNumberCases = false;
-  bool CrashOnI1Select = false;
-  bool CrashIfWeakGlobalExists = false;
-  bool InfLoopOnIndirectCall = false;
-  bool BugOnlyIfOddNumberInsts = false;
-  bool BugOnlyIfInternalFunc = false;
-  bool BugOnlyIfExternalFunc = false;
-  bool InsertUnparseableAsm = false;
-  bool MiscompileICmpSltToSle = false;
-  bool CrashOnBuggyAttr = false;
-  bool CrashOnBuggyGlobalState = false;
-
-  bool needBuggyAttrPass() const {
-    return CrashOnBuggyAttr || CrashOnBuggyGlobalState;
+  /// One bit per option in BuggyOptions.def, so a group of them can be tested
+  /// at once and the whole set compared or hashed as one value.
+  uint64_t Flags = 0;
+
+#define BUGGY_OPTION(Field, Name)                                              \
+  static constexpr uint64_t Field = uint64_t(1) << BuggyOptionBit##Field;      \
+  bool has##Field() const { return (Flags & Field) != 0; }
+#include "BuggyOptions.def"
+
+  /// Options that need BuggyAttrPass to run first.
+  static constexpr uint64_t AnyBuggyAttrBug =
+      CrashOnBuggyAttr | CrashOnBuggyGlobalState;
+
+  /// Whether any of the options in \p Mask is enabled.
+  bool hasAny(uint64_t Mask) const { return (Flags & Mask) != 0; }
+
+  void set(uint64_t Mask, bool Enable) {
+    Flags = Enable ? Flags | Mask : Flags & ~Mask;
+  }
+
+  /// If nonzero, infloop-on-indirect-call spins for this many milliseconds
+  /// and then exits with BuggyHangExitCode instead of spinning forever.
+  unsigned InfLoopMs = 0;
+
+  /// Like a DebugCounter, miscompile-icmp-slt-to-sle leaves the first
+  /// MiscompileSkip sites alone and then rewrites MiscompileCount of them,
+  /// or all the rest if MiscompileCount is 0. Sites are numbered in the order
+  /// the pass rewrites them.
+  unsigned MiscompileSkip = 0;
+  unsigned MiscompileCount = 0;
+
+  /// If set, a fatal error first writes its stable ID and name here. The
+  /// file is removed whenever the pass starts on a function or module, so it
+  /// only exists after a run that hit an error, rather than being left over
+  /// from an earlier one (or an earlier module in buggy-oracle).
+  std::string SignatureFile;
+
+  /// With VerdictCache, also keep the verdicts in this directory to share
+  /// them between processes.
+  std::string VerdictCacheDir;
+
+  /// If set, write what was found in each function checked to this JSON file.
+  /// Implies DryRun.
+  std::string ReportFile;
+
+  /// The ThinOrFullLTOPhase values, as bits of 1 << Phase, of the default
+  /// pipelines the clang plugin adds BuggyPass and BuggyAttrPass to. Only
+  /// used through BUGGY_PLUGIN_OPTS; explicit pipelines ignore them. The
+  /// default leaves out the full LTO link, which the OptimizerEarly callback
+  /// the passes were always added from is not invoked for.
+  static constexpr unsigned DefaultPhases =
+      1u << unsigned(ThinOrFullLTOPhase::None) |
+      1u << unsigned(ThinOrFullLTOPhase::ThinLTOPreLink) |
+      1u << unsigned(ThinOrFullLTOPhase::ThinLTOPostLink) |
+      1u << unsigned(ThinOrFullLTOPhase::FullLTOPreLink);
+  unsigned BuggyPhases = DefaultPhases;
+  unsigned BuggyAttrPhases = DefaultPhases;
+
+  bool runsBuggyIn(ThinOrFullLTOPhase Phase) const {
+    return (BuggyPhases & (1u << unsigned(Phase))) != 0;
+  }
+  bool runsBuggyAttrIn(ThinOrFullLTOPhase Phase) const {
+    return (BuggyAttrPhases & (1u << unsigned(Phase))) != 0;
+  }
+
+  bool needBuggyAttrPass() const { return hasAny(AnyBuggyAttrBug); }
+
+  /// Whether BuggyPass reads anything from BuggyModuleAnalysis.
+  bool needModuleFacts() const {
+    return hasCrashIfWeakGlobalExists() || hasCrashOnBuggyAttr();
   }
+
+  unsigned getInstCheckMask() const;
+
+  /// Print the enabled options in pass parameter syntax, each followed by ';'.
+  void printParams(raw_ostream &OS) const;
 };
 
+/// Bug classes decided by looking at individual instructions. A BuggyPass
+/// scan loop can be specialized on a mask of these.
+/// Position of each instruction check, in the order of BuggyOptions.def.
+enum BuggyInstCheckIndex : unsigned {
+#define BUGGY_OPTION(Field, Name)
+#define BUGGY_CHECK_OPTION(Field, Name, Check) CheckIndex##Check,
+#define BUGGY_BUG_CHECK_OPTION(Field, Name, Bug) CheckIndex##Bug,
+#include "BuggyOptions.def"
+  NumInstChecks
+};
+
+enum BuggyInstCheck : unsigned {
+#define BUGGY_OPTION(Field, Name)
+#define BUGGY_CHECK_OPTION(Field, Name, Id) Check##Id = 1u << CheckIndex##Id,
+#define BUGGY_BUG_CHECK_OPTION(Field, Name, Bug)                               \
+  BUGGY_CHECK_OPTION(Field, Name, Bug)
+#include "BuggyOptions.def"
+};
+
+/// Position of \p Check among the BuggyInstCheck values.
+constexpr unsigned getCheckIndex(BuggyInstCheck Check) {
+  return llvm::countr_zero(unsigned(Check));
+}
+
+constexpr unsigned PhiChecks =
+    CheckPhiRepeatedPredecessor | CheckPhiSelfReference | CheckAggregatePhi;
+
+/// Checks that only look at the PHIs at the start of a block or at its
+/// terminator, the only regions of a block that can be found without walking
+/// it. Loads, stores and calls can sit anywhere in the body, so every other
+/// check still needs the full walk.
+constexpr unsigned BlockEdgeChecks = PhiChecks | CheckSwitchOddNumberCases;
+
+/// Cheap predicates the probe option evaluates before deciding whether a
+/// function needs to be walked at all.
+enum BuggyProbePredicate : unsigned {
+  /// Ruled out by bug-only-if-internal-func or bug-only-if-external-func.
+  ProbeLinkage = 1 << 0,
+  /// No enabled check looks at individual instructions.
+  ProbeNoInstChecks = 1 << 1,
+  /// No block starts with a PHI.
+  ProbeNoPhis = 1 << 2,
+  /// No block ends in a switch with an odd number of cases.
+  ProbeNoOddSwitch = 1 << 3,
+  /// Nothing could fire, so the odd-number gate was not evaluated.
+  ProbeNothingToGate = 1 << 4,
+  /// Ruled out by bug-only-if-odd-number-insts.
+  ProbeEvenInsts = 1 << 5
+};
+
+/// The fatal errors the buggy pass can report. The values are stable, since
+/// interestingness tests match on them through exit-code and signature-file.
+enum class BuggyBugKind : unsigned {
+  None = 0,
+  Vector = 1,
+  ShuffleVector = 2,
+  LoadOfIntToPtr = 3,
+  StoreToConstantExpr = 4,
+  AggregatePhi = 5,
+  PhiRepeatedPredecessor = 6,
+  PhiSelfReference = 7,
+  SwitchOddNumberCases = 8,
+  I1Select = 9,
+  WeakGlobal = 10,
+  BuggyAttr = 11,
+  BuggyGlobalState = 12
+};
+
+/// With exit-code, a fatal error exits with this plus its BuggyBugKind.
+static constexpr int BuggyBugExitCodeBase = 100;
+
 static volatile int side_effect;
+
+/// Exit status of a bounded infloop-on-indirect-call. Distinct from the 124
+/// and 125 of timeout(1) and from the exit-code statuses, so a test can tell
+/// the simulated hang from a real timeout.
+static constexpr int BuggyHangExitCode = 99;
+
+/// Exit statuses of buggy-unreachable-check, which returns normally if every
+/// block of every defined function is reachable.
+static constexpr int BuggyUnreachableFoundExitCode = 120;
+static constexpr int BuggyNoDefinedFunctionsExitCode = 121;
 static StringLiteral Name = "buggy";
 static StringLiteral PassName = "buggy";
 
-static bool BuggyGlobalFlag = false;
+/// Pipeline name of BuggyModuleAnalysis, so require<buggy-module-facts> and
+/// invalidate<buggy-module-facts> print and parse back like the built-in
+/// analyses do.
+static StringLiteral ModuleFactsName = "buggy-module-facts";
+
+/// Instructions of a function and the constructs the per-instruction checks
+/// look for among them, counted regardless of the enabled options.
+struct BuggyConstructCounts {
+  unsigned ShuffleVectors = 0;
+  unsigned VectorValues = 0;
+  unsigned IntToPtrLoads = 0;
+  unsigned ConstantExprStores = 0;
+  unsigned OddSwitches = 0;
+  unsigned I1Selects = 0;
+  unsigned IndirectCalls = 0;
+  size_t Instructions = 0;
+};
+
+/// Results collected while walking a function with the enabled checks.
+struct BuggyScanState {
+  /// The first fatal error encountered, if any.
+  BuggyBugKind Crash = BuggyBugKind::None;
+
+  /// Set if an indirect call was reached before any fatal error.
+  bool Hang = false;
+
+  /// The icmp slt instructions to rewrite. The walk only queues them, since
+  /// the odd-number gate is only known once it is done and the sites are
+  /// numbered in the order they are applied.
+  SmallVector<ICmpInst *, 8> PendingRewrites;
+
+  /// BuggyProbePredicate values that held. The linkage and odd-number gates
+  /// are always recorded, the rest only when probing.
+  unsigned ProbeResults = 0;
+
+  /// Whether the instruction walk was skipped because of ProbeResults.
+  bool SkippedWalk = false;
+
+  /// Whether the result was taken from the verdict cache.
+  bool CachedVerdict = false;
+
+  /// Time spent in BuggyPass::analyze, only measured for the report option.
+  uint64_t CheckNs = 0;
+
+  /// Instructions walked, and instructions visited by each check, indexed by
+  /// getCheckIndex. Added to the statistics once the function is done.
+  size_t NumInsts = 0;
+  unsigned Visited[NumInstChecks] = {};
+
+  /// Counted by scanFunctionReported for the report option, in the same walk
+  /// as the checks.
+  std::optional<BuggyConstructCounts> Constructs;
+
+  /// Predecessors seen by crash-on-repeated-phi-predecessor, each stamped
+  /// with the PhiGeneration of the PHI that saw it last. Each PHI starts a
+  /// new generation instead of clearing the map, which SmallPtrSet::clear
+  /// would shrink again after a wide PHI, so the map only grows to the number
+  /// of distinct predecessors in the function.
+  SmallDenseMap<BasicBlock *, unsigned, 16> PhiPreds;
+  unsigned PhiGeneration = 0;
+
+  void visit(BuggyInstCheck Check) { ++Visited[getCheckIndex(Check)]; }
+};
+
+/// A check run on an instruction with a matching opcode. Returns true once a
+/// terminal event was recorded and no further instructions need checking.
+using BuggyCheckFn = bool (*)(Instruction &I, BuggyScanState &State);
+
+/// The enabled per-instruction checks, bucketed by opcode so each instruction
+/// costs a single lookup.
+class BuggyCheckTable {
+  static constexpr unsigned NumOpcodes = Instruction::OtherOpsEnd;
+  SmallVector<BuggyCheckFn, 2> Checks[NumOpcodes];
+
+  void add(unsigned Opcode, BuggyCheckFn Check) {
+    Checks[Opcode].push_back(Check);
+  }
+
+public:
+  explicit BuggyCheckTable(const BuggyOptions &Options);
+
+  ArrayRef<BuggyCheckFn> lookup(unsigned Opcode) const {
+    return Checks[Opcode];
+  }
+};
+
+/// Module-wide facts used by BuggyPass, computed once per module instead of
+/// once per function. BuggyPass only ever reads a cached result; something at
+/// module level must require it first.
+class BuggyModuleAnalysis : public AnalysisInfoMixin<BuggyModuleAnalysis> {
+  friend AnalysisInfoMixin<BuggyModuleAnalysis>;
+  static AnalysisKey Key;
+
+public:
+  struct Result {
+    bool HasWeakGlobal = false;
+
+    /// Whether BuggyAttrPass tagged the whole module with the buggy-attr
+    /// module flag rather than each function.
+    bool HasBuggyAttrFlag = false;
+
+    /// Function passes may only query module analyses that survive
+    /// invalidation, so this is treated as stateless and only dropped when
+    /// explicitly abandoned. Use addBuggyModuleFacts to recompute it.
+    bool invalidate(Module &, const PreservedAnalyses &PA,
+                    ModuleAnalysisManager::Invalidator &) {
+      return !PA.getChecker<BuggyModuleAnalysis>().preservedWhenStateless();
+    }
+  };
+
+  Result run(Module &M, ModuleAnalysisManager &AM);
+};
+
+/// Hidden state BuggyAttrPass leaves behind for crash-on-buggy-global-state.
+/// Like the process-wide flag it replaces, it is not visible in the IR and
+/// survives any IR change. It is scoped to one module in one analysis
+/// manager, though, so concurrent or back-to-back compilations in the same
+/// process no longer see each other's state.
+class BuggyGlobalStateAnalysis
+    : public AnalysisInfoMixin<BuggyGlobalStateAnalysis> {
+  friend AnalysisInfoMixin<BuggyGlobalStateAnalysis>;
+  static AnalysisKey Key;
+
+public:
+  class Result {
+    std::atomic<bool> Modified{false};
+
+  public:
+    Result() = default;
+    Result(Result &&Other) : Modified(Other.Modified.load()) {}
+
+    void setModified() { Modified.store(true, std::memory_order_relaxed); }
+    bool isModified() const {
+      return Modified.load(std::memory_order_relaxed);
+    }
+
+    bool invalidate(Module &, const PreservedAnalyses &,
+                    ModuleAnalysisManager::Invalidator &) {
+      return false;
+    }
+  };
+
+  Result run(Module &, ModuleAnalysisManager &) { return Result(); }
+};
+
+/// Module-level inputs to BuggyPass::analyze, looked up once by the caller.
+struct BuggyModuleInfo {
+  const BuggyModuleAnalysis::Result *Facts = nullptr;
+  bool GlobalStateModified = false;
+};
+
+/// Walks a function with the enabled checks and returns the number of
+/// instructions visited.
+using BuggyScanFn = size_t (*)(Function &F, const BuggyCheckTable &Table,
+                               BuggyScanState &State, bool CountAll);
+
+/// The JSON file written with the report option: an array with one object
+/// per function checked, appended as each function is done. Everything goes
+/// through the buffer of the file stream, which only writes once it fills and
+/// when the report is closed, so the report costs next to nothing compared to
+/// the checks. The file is opened by the first function reported, so passes
+/// that never run do not truncate it.
+class BuggyReport {
+  std::string Path;
+  std::unique_ptr<raw_fd_ostream> OS;
+  std::optional<json::OStream> J;
+  bool Failed = false;
+
+public:
+  explicit BuggyReport(StringRef Path) : Path(Path.str()) {}
+  ~BuggyReport();
+
+  void write(Function &F, const BuggyScanState &State);
+};
 
 class BuggyPass : public PassInfoMixin<BuggyPass> {
   const BuggyOptions Options;
+  const BuggyCheckTable Checks;
+  const unsigned InstChecks;
+  const BuggyScanFn Scan;
+  const uint64_t OptionsHash;
+
+  /// icmp slt sites reached so far, to apply MiscompileSkip and
+  /// MiscompileCount across all the functions this pass runs on.
+  unsigned NumSltSites = 0;
+
+  /// Set with the report option. Shared, since the pass managers copy passes.
+  std::shared_ptr<BuggyReport> Report;
 
 public:
-  BuggyPass(BuggyOptions Opts = BuggyOptions()) : Options(Opts) {}
+  BuggyPass(BuggyOptions Opts = BuggyOptions());
 
   static StringRef name() { return PassName; }
 
+  const BuggyOptions &getOptions() const { return Options; }
+
   void printPipeline(raw_ostream &OS,
                      function_ref<StringRef(StringRef)> MapClassName2PassName);
   PreservedAnalyses run(Function &F, FunctionAnalysisManager &AM);
+
+  /// Decide what the pass would do to \p F without acting on it. Returns
+  /// false if \p F is ruled out by one of the bug-only-if gates. Never
+  /// modifies the IR, so it is safe to run on several functions at once.
+  bool analyze(Function &F, const BuggyModuleInfo &Info,
+               BuggyScanState &State) const;
+
+  /// Like analyze, but also measures the time taken if it is to be reported.
+  bool analyzeTimed(Function &F, const BuggyModuleInfo &Info,
+                    BuggyScanState &State) const;
+
+  /// Act on the result of analyze: crash, hang or apply IR changes.
+  PreservedAnalyses apply(Function &F, BuggyScanState &State);
+
+  /// Add the result of analyze for \p F to the report, if there is one.
+  void report(Function &F, const BuggyScanState &State) {
+    if (Report)
+      Report->write(F, State);
+  }
+
+  /// Remove the signature file of an earlier run, if there is one to write.
+  void clearSignature() const {
+    if (!Options.SignatureFile.empty())
+      sys::fs::remove(Options.SignatureFile);
+  }
+
+private:
+  bool analyzeUncached(Function &F, const BuggyModuleInfo &Info,
+                       BuggyScanState &State) const;
+
+  /// Key for the verdict on \p F under these options, covering everything
+  /// analyze looks at.
+  uint64_t getVerdictKey(Function &F, const BuggyModuleInfo &Info) const;
+
+  /// Whether \p State, returned by analyzeUncached, is safe to replay.
+  bool isCacheableVerdict(const BuggyScanState &State) const;
+
+  /// Report the fatal error \p Kind in the way selected by the options.
+  [[noreturn]] void reportBug(BuggyBugKind Kind) const;
+
+  /// Rewrite the selected sites among \p ICmps, emitting a remark for each
+  /// site whether it was rewritten or not.
+  void rewriteICmps(Function &F, ArrayRef<ICmpInst *> ICmps);
+};
+
+struct BuggyParallelOptions {
+  unsigned Threads = 0;
+  BuggyOptions Options;
 };
 
+/// Module pass running the BuggyPass checks for all functions concurrently.
+/// Any IR changes and the first failure in module order are then applied
+/// serially, matching what a plain run of buggy would do.
+class BuggyParallelPass : public PassInfoMixin<BuggyParallelPass> {
+  BuggyPass Impl;
+  unsigned Threads;
+
+public:
+  BuggyParallelPass(BuggyParallelOptions Opts)
+      : Impl(Opts.Options), Threads(Opts.Threads) {}
+
+  static StringRef name() { return "buggy-parallel"; }
+
+  void printPipeline(raw_ostream &OS,
+                     function_ref<StringRef(StringRef)> MapClassName2PassName);
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+};
+
+/// Tags every defined function for crash-on-buggy-attr. By default each
+/// function gets a "buggy-attr" string attribute. With UseModuleFlag, a single
+/// "buggy-attr" module flag stands for all of them instead, which avoids
+/// rebuilding an attribute list for every function of a large module. Unlike
+/// the attribute, the flag also covers functions added to the module later.
 class BuggyAttrPass : public PassInfoMixin<BuggyAttrPass> {
+  bool UseModuleFlag;
+
 public:
-  BuggyAttrPass() {}
+  BuggyAttrPass(bool UseModuleFlag = false) : UseModuleFlag(UseModuleFlag) {}
   PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
 
   static StringRef name() { return "buggy-attr"; }
+
+  void printPipeline(raw_ostream &OS,
+                     function_ref<StringRef(StringRef)> MapClassName2PassName);
+};
+
+/// Test for the llvm-reduce meta-reduction example. Decides from the CFG,
+/// rather than from "; No predecessors!" comments in the printed IR, whether
+/// any defined function has a block unreachable from its entry, and reports
+/// the answer as the exit status: BuggyUnreachableFoundExitCode if so,
+/// BuggyNoDefinedFunctionsExitCode if the module defines no function at all.
+class BuggyUnreachableCheckPass
+    : public PassInfoMixin<BuggyUnreachableCheckPass> {
+public:
+  PreservedAnalyses run(Module &M, ModuleAnalysisManager &AM);
+
+  static StringRef name() { return "buggy-unreachable-check"; }
 };
 
 } // anonymous namespace
 
+AnalysisKey BuggyModuleAnalysis::Key;
+AnalysisKey BuggyGlobalStateAnalysis::Key;
+
+static bool hasWeakGlobal(const Module &M) {
+  return any_of(M.globals(),
+                [](const GlobalValue &GV) { return GV.hasWeakLinkage(); });
+}
+
+static bool hasBuggyAttrFlag(const Module &M) {
+  return M.getModuleFlag("buggy-attr") != nullptr;
+}
+
+/// Whether BuggyAttrPass tagged \p F, either directly or through the module
+/// flag.
+static bool hasBuggyAttr(const Function &F, const BuggyModuleInfo &Info) {
+  if (F.hasFnAttribute("buggy-attr"))
+    return true;
+  return Info.Facts ? Info.Facts->HasBuggyAttrFlag
+                    : hasBuggyAttrFlag(*F.getParent());
+}
+
+BuggyModuleAnalysis::Result BuggyModuleAnalysis::run(Module &M,
+                                                     ModuleAnalysisManager &) {
+  Result R;
+  R.HasWeakGlobal = hasWeakGlobal(M);
+  R.HasBuggyAttrFlag = hasBuggyAttrFlag(M);
+  return R;
+}
+
+/// Schedule a fresh computation of the module facts ahead of BuggyPass.
+static void addBuggyModuleFacts(ModulePassManager &MPM) {
+  MPM.addPass(InvalidateAnalysisPass<BuggyModuleAnalysis>());
+  MPM.addPass(RequireAnalysisPass<BuggyModuleAnalysis, Module>());
+}
+
+unsigned BuggyOptions::getInstCheckMask() const {
+  unsigned Mask = 0;
+#define BUGGY_OPTION(Field, Name)
+#define BUGGY_CHECK_OPTION(Field, Name, Id)                                    \
+  if (has##Field())                                                            \
+    Mask |= Check##Id;
+#define BUGGY_BUG_CHECK_OPTION(Field, Name, Bug)                               \
+  BUGGY_CHECK_OPTION(Field, Name, Bug)
+#include "BuggyOptions.def"
+  return Mask;
+}
+
+/// Names of the ThinOrFullLTOPhase values in buggy-phase and buggy-attr-phase.
+static const std::pair<ThinOrFullLTOPhase, StringLiteral> PhaseNames[] = {
+    {ThinOrFullLTOPhase::None, "none"},
+    {ThinOrFullLTOPhase::ThinLTOPreLink, "thin-prelink"},
+    {ThinOrFullLTOPhase::ThinLTOPostLink, "thin-postlink"},
+    {ThinOrFullLTOPhase::FullLTOPreLink, "full-prelink"},
+    {ThinOrFullLTOPhase::FullLTOPostLink, "full-postlink"}};
+
+/// Print the phases in \p Phases as a ','-separated list of names.
+static void printPhases(raw_ostream &OS, unsigned Phases) {
+  ListSeparator LS(",");
+  for (const auto &[Phase, PhaseName] : PhaseNames) {
+    if (Phases & (1u << unsigned(Phase)))
+      OS << LS << PhaseName;
+  }
+}
+
+/// Parse a ','-separated list of phase names into \p Phases. Returns true on
+/// error.
+static bool parsePhases(StringRef List, unsigned &Phases) {
+  Phases = 0;
+  SmallVector<StringRef, 4> Names;
+  List.split(Names, ',', /*MaxSplit=*/-1, /*KeepEmpty=*/false);
+  for (StringRef Name : Names) {
+    const auto *It = find_if(PhaseNames, [&](const auto &Entry) {
+      return Entry.second == Name;
+    });
+    if (It == std::end(PhaseNames))
+      return true;
+    Phases |= 1u << unsigned(It->first);
+  }
+  return false;
+}
+
+void BuggyOptions::printParams(raw_ostream &OS) const {
+#define BUGGY_OPTION(Field, Name)                                              \
+  if (has##Field())                                                            \
+    OS << Name << ';';
+#include "BuggyOptions.def"
+
+  if (InfLoopMs != 0)
+    OS << "infloop-ms=" << InfLoopMs << ';';
+  if (MiscompileSkip != 0)
+    OS << "miscompile-skip=" << MiscompileSkip << ';';
+  if (MiscompileCount != 0)
+    OS << "miscompile-count=" << MiscompileCount << ';';
+  if (!SignatureFile.empty())
+    OS << "signature-file=" << SignatureFile << ';';
+  // verdict-cache-dir and report turn on verdict-cache and dry-run when
+  // parsed, so a flag turned off again after them has to follow them.
+  if (!VerdictCacheDir.empty()) {
+    OS << "verdict-cache-dir=" << VerdictCacheDir << ';';
+    if (!hasVerdictCache())
+      OS << "no-verdict-cache;";
+  }
+  if (!ReportFile.empty()) {
+    OS << "report=" << ReportFile << ';';
+    if (!hasDryRun())
+      OS << "no-dry-run;";
+  }
+  if (BuggyPhases != DefaultPhases) {
+    OS << "buggy-phase=";
+    printPhases(OS, BuggyPhases);
+    OS << ';';
+  }
+  if (BuggyAttrPhases != DefaultPhases) {
+    OS << "buggy-attr-phase=";
+    printPhases(OS, BuggyAttrPhases);
+    OS << ';';
+  }
+}
+
 void BuggyPass::printPipeline(
     raw_ostream &OS, function_ref<StringRef(StringRef)> MapClassName2PassName) {
   static_cast<PassInfoMixin<BuggyPass> *>(this)->printPipeline(
       OS, MapClassName2PassName);
   OS << '<';
-  if (Options.CrashOnVector)
-    OS << "crash-on-vector;";
-  if (Options.CrashOnShuffleVector)
-    OS << "crash-on-shufflevector;";
-  if (Options.CrashOnAggregatePhi)
-    OS << "crash-on-aggregate-phi;";
-  if (Options.CrashOnPhiRepeatedPredecessor)
-    OS << "crash-on-repeated-phi-predecessor;";
-  if (Options.CrashOnPhiSelfReference)
-    OS << "crash-on-phi-self-reference;";
-  if (Options.CrashOnLoadOfIntToPtr)
-    OS << "crash-load-of-inttoptr;";
-  if (Options.CrashOnStoreToConstantExpr)
-    OS << "crash-store-to-constantexpr;";
-  if (Options.CrashOnSwitchOddNumberCases)
-    OS << "crash-switch-odd-number-cases;";
-  if (Options.CrashOnI1Select)
-    OS << "crash-on-i1-select;";
-  if (Options.CrashIfWeakGlobalExists)
-    OS << "crash-if-weak-global-exists;";
-  if (Options.InfLoopOnIndirectCall)
-    OS << "infloop-on-indirect-call;";
-  if (Options.BugOnlyIfOddNumberInsts)
-    OS << "bug-only-if-odd-number-insts;";
-  if (Options.BugOnlyIfInternalFunc)
-    OS << "bug-only-if-internal-func;";
-  if (Options.BugOnlyIfExternalFunc)
-    OS << "bug-only-if-external-func;";
-  if (Options.InsertUnparseableAsm)
-    OS << "insert-unparseable-asm;";
-  if (Options.MiscompileICmpSltToSle)
-    OS << "miscompile-icmp-slt-to-sle;";
-  if (Options.CrashOnBuggyAttr)
-    OS << "crash-on-buggy-attr;";
-  if (Options.CrashOnBuggyGlobalState)
-    OS << "crash-on-buggy-global-state;";
+  Options.printParams(OS);
   OS << '>';
 }
 
-PreservedAnalyses BuggyPass::run(Function &F, FunctionAnalysisManager &AM) {
-  bool Changed = false;
+void BuggyParallelPass::printPipeline(
+    raw_ostream &OS, function_ref<StringRef(StringRef)> MapClassName2PassName) {
+  static_cast<PassInfoMixin<BuggyParallelPass> *>(this)->printPipeline(
+      OS, MapClassName2PassName);
+  OS << '<';
+  if (Threads != 0)
+    OS << "threads=" << Threads << ';';
+  Impl.getOptions().printParams(OS);
+  OS << '>';
+}
 
-  if (Options.BugOnlyIfInternalFunc && !F.hasInternalLinkage())
-    return PreservedAnalyses::all();
-  if (Options.BugOnlyIfExternalFunc && !F.hasExternalLinkage())
-    return PreservedAnalyses::all();
+static bool crash(BuggyScanState &State, BuggyBugKind Kind) {
+  State.Crash = Kind;
+  return true;
+}
+
+/// Return the option enabling \p Kind, which also names it in signature
+/// files.
+static StringRef getBugKindName(BuggyBugKind Kind) {
+  switch (Kind) {
+  case BuggyBugKind::None:
+    return "none";
+#define BUGGY_OPTION(Field, Name)
+#define BUGGY_BUG_OPTION(Field, Name, Kind)                                    \
+  case BuggyBugKind::Kind:                                                     \
+    return Name;
+#define BUGGY_BUG_CHECK_OPTION(Field, Name, Bug)                               \
+  BUGGY_BUG_OPTION(Field, Name, Bug)
+#include "BuggyOptions.def"
+  }
+  llvm_unreachable("unknown bug kind");
+}
+
+static const char *getBugKindMessage(BuggyBugKind Kind) {
+  switch (Kind) {
+  case BuggyBugKind::None:
+    break;
+  case BuggyBugKind::Vector:
+    return "vector instructions are broken";
+  case BuggyBugKind::ShuffleVector:
+    return "shufflevector instructions are broken";
+  case BuggyBugKind::LoadOfIntToPtr:
+    return "load of inttoptr is broken";
+  case BuggyBugKind::StoreToConstantExpr:
+    return "store to constantexpr pointer is broken";
+  case BuggyBugKind::AggregatePhi:
+    return "aggregate phis are broken";
+  case BuggyBugKind::PhiRepeatedPredecessor:
+    return "phi with repeated predecessor is broken";
+  case BuggyBugKind::PhiSelfReference:
+    return "self referential phi is broken";
+  case BuggyBugKind::SwitchOddNumberCases:
+    return "switch with odd number of cases is broken";
+  case BuggyBugKind::I1Select:
+    return "i1 typed select is broken";
+  case BuggyBugKind::WeakGlobal:
+    return "broken if there is a weak global";
+  case BuggyBugKind::BuggyAttr:
+    return "buggy-attr is broken";
+  case BuggyBugKind::BuggyGlobalState:
+    return "pass depends on modified global state";
+  }
+  llvm_unreachable("no message for bug kind");
+}
+
+static bool checkICmpSltToSle(Instruction &I, BuggyScanState &State) {
+  State.visit(CheckICmpSltToSle);
+  auto &ICmp = cast<ICmpInst>(I);
+  if (ICmp.getPredicate() == ICmpInst::ICMP_SLT)
+    State.PendingRewrites.push_back(&ICmp);
+  return false;
+}
+
+static bool checkSwitchOddNumberCases(Instruction &I, BuggyScanState &State) {
+  State.visit(CheckSwitchOddNumberCases);
+  if (cast<SwitchInst>(I).getNumCases() & 1)
+    return crash(State, BuggyBugKind::SwitchOddNumberCases);
+  return false;
+}
+
+static bool checkShuffleVector(Instruction &I, BuggyScanState &State) {
+  State.visit(CheckShuffleVector);
+  return crash(State, BuggyBugKind::ShuffleVector);
+}
+
+static bool checkVector(Instruction &I, BuggyScanState &State) {
+  State.visit(CheckVector);
+  if (isa<VectorType>(I.getType()))
+    return crash(State, BuggyBugKind::Vector);
+  return false;
+}
+
+/// Run the PHI checks in \p Mask on \p I with one sweep over its incoming
+/// list. Failures are still reported in the order crash-on-repeated-phi-
+/// predecessor, crash-on-phi-self-reference, crash-on-aggregate-phi.
+template <unsigned Mask>
+static bool checkPhi(Instruction &I, BuggyScanState &State) {
+  static_assert(Mask != 0 && (Mask & ~PhiChecks) == 0,
+                "expected a set of PHI checks");
+  constexpr bool CheckRepeated = (Mask & CheckPhiRepeatedPredecessor) != 0;
+  constexpr bool CheckSelf = (Mask & CheckPhiSelfReference) != 0;
+  auto &Phi = cast<PHINode>(I);
+
+  bool Repeated = false;
+  bool SelfReference = false;
+  if constexpr (CheckRepeated || CheckSelf) {
+    const unsigned NumIncoming = Phi.getNumIncomingValues();
+    const unsigned Generation = CheckRepeated ? ++State.PhiGeneration : 0;
+    for (unsigned Idx = 0; Idx != NumIncoming; ++Idx) {
+      if constexpr (CheckRepeated) {
+        // A repeated predecessor is reported first, so nothing else matters
+        // once one is found.
+        if (NumIncoming > 1) {
+          unsigned &Seen = State.PhiPreds[Phi.getIncomingBlock(Idx)];
+          if (Seen == Generation) {
+            Repeated = true;
+            break;
+          }
+          Seen = Generation;
+        }
+      }
+      if constexpr (CheckSelf)
+        SelfReference |= Phi.getIncomingValue(Idx) == &Phi;
+    }
+  }
+
+  if constexpr (CheckRepeated) {
+    State.visit(CheckPhiRepeatedPredecessor);
+    if (Repeated)
+      return crash(State, BuggyBugKind::PhiRepeatedPredecessor);
+  }
+  if constexpr (CheckSelf) {
+    State.visit(CheckPhiSelfReference);
+    if (SelfReference)
+      return crash(State, BuggyBugKind::PhiSelfReference);
+  }
+  if constexpr ((Mask & CheckAggregatePhi) != 0) {
+    State.visit(CheckAggregatePhi);
+    if (I.getType()->isAggregateType())
+      return crash(State, BuggyBugKind::AggregatePhi);
+  }
+  return false;
+}
+
+/// Return the checkPhi instantiation for the PHI checks in \p Mask.
+static BuggyCheckFn selectPhiCheck(unsigned Mask) {
+  switch (Mask & PhiChecks) {
+  case CheckPhiRepeatedPredecessor:
+    return checkPhi<CheckPhiRepeatedPredecessor>;
+  case CheckPhiSelfReference:
+    return checkPhi<CheckPhiSelfReference>;
+  case CheckAggregatePhi:
+    return checkPhi<CheckAggregatePhi>;
+  case CheckPhiRepeatedPredecessor | CheckPhiSelfReference:
+    return checkPhi<CheckPhiRepeatedPredecessor | CheckPhiSelfReference>;
+  case CheckPhiRepeatedPredecessor | CheckAggregatePhi:
+    return checkPhi<CheckPhiRepeatedPredecessor | CheckAggregatePhi>;
+  case CheckPhiSelfReference | CheckAggregatePhi:
+    return checkPhi<CheckPhiSelfReference | CheckAggregatePhi>;
+  case PhiChecks:
+    return checkPhi<PhiChecks>;
+  default:
+    return nullptr;
+  }
+}
+
+static bool checkI1Select(Instruction &I, BuggyScanState &State) {
+  State.visit(CheckI1Select);
+  if (I.getType()->isIntegerTy(1))
+    return crash(State, BuggyBugKind::I1Select);
+  return false;
+}
+
+static bool checkStoreToConstantExpr(Instruction &I, BuggyScanState &State) {
+  State.visit(CheckStoreToConstantExpr);
+  if (isa<ConstantExpr>(cast<StoreInst>(I).getPointerOperand()))
+    return crash(State, BuggyBugKind::StoreToConstantExpr);
+  return false;
+}
 
-  if (Options.CrashOnBuggyAttr && F.hasFnAttribute("buggy-attr"))
-    report_fatal_error("buggy-attr is broken");
+static bool checkLoadOfIntToPtr(Instruction &I, BuggyScanState &State) {
+  State.visit(CheckLoadOfIntToPtr);
+  if (isa<IntToPtrInst>(cast<LoadInst>(I).getPointerOperand()))
+    return crash(State, BuggyBugKind::LoadOfIntToPtr);
+  return false;
+}
+
+static bool checkIndirectCall(Instruction &I, BuggyScanState &State) {
+  State.visit(CheckIndirectCall);
+  if (cast<CallBase>(I).getCalledFunction())
+    return false;
+  State.Hang = true;
+  return true;
+}
 
-  if (Options.CrashOnBuggyGlobalState && BuggyGlobalFlag)
-    report_fatal_error("pass depends on modified global state");
+BuggyCheckTable::BuggyCheckTable(const BuggyOptions &Options) {
+  // Checks are appended in the order the original per-instruction if-chain
+  // tested them, so an instruction hitting several checks reports the same
+  // error as before.
+  if (Options.hasMiscompileICmpSltToSle())
+    add(Instruction::ICmp, checkICmpSltToSle);
+  if (Options.hasCrashOnSwitchOddNumberCases())
+    add(Instruction::Switch, checkSwitchOddNumberCases);
+  if (Options.hasCrashOnShuffleVector())
+    add(Instruction::ShuffleVector, checkShuffleVector);
+  if (Options.hasCrashOnVector()) {
+    for (unsigned Opcode = 0; Opcode != NumOpcodes; ++Opcode)
+      add(Opcode, checkVector);
+  }
+  if (BuggyCheckFn PhiCheck = selectPhiCheck(Options.getInstCheckMask()))
+    add(Instruction::PHI, PhiCheck);
+  if (Options.hasCrashOnI1Select())
+    add(Instruction::Select, checkI1Select);
+  if (Options.hasCrashOnStoreToConstantExpr())
+    add(Instruction::Store, checkStoreToConstantExpr);
+  if (Options.hasCrashOnLoadOfIntToPtr())
+    add(Instruction::Load, checkLoadOfIntToPtr);
+  if (Options.hasInfLoopOnIndirectCall()) {
+    add(Instruction::Call, checkIndirectCall);
+    add(Instruction::Invoke, checkIndirectCall);
+    add(Instruction::CallBr, checkIndirectCall);
+  }
+}
 
+/// Run the enabled checks over \p F in a single walk, stopping at the first
+/// terminal event. If \p CountAll is set, keep walking to finish counting
+/// instructions. This is the generic version driven by the opcode table.
+static size_t scanFunction(Function &F, const BuggyCheckTable &Table,
+                           BuggyScanState &State, bool CountAll) {
   size_t InstCount = 0;
-  if (Options.BugOnlyIfOddNumberInsts) {
+  bool Stopped = false;
+  for (BasicBlock &BB : F) {
+    for (Instruction &I : BB) {
+      ++InstCount;
+      if (Stopped)
+        continue;
+
+      for (BuggyCheckFn Check : Table.lookup(I.getOpcode())) {
+        if (Check(I, State)) {
+          Stopped = true;
+          break;
+        }
+      }
+    }
+
+    if (Stopped && !CountAll)
+      break;
+  }
+
+  return InstCount;
+}
+
+/// Run the table's checks for \p I. Returns true at a terminal event.
+static bool runTableChecks(const BuggyCheckTable &Table, Instruction &I,
+                           BuggyScanState &State) {
+  for (BuggyCheckFn Check : Table.lookup(I.getOpcode())) {
+    if (Check(I, State))
+      return true;
+  }
+  return false;
+}
+
+/// Version of scanFunction for checks within BlockEdgeChecks. Visits only the
+/// leading PHIs and the terminator of each block, in the same order as the
+/// full walk, and skips the rest of the body, so it reports the same first
+/// error. With \p CountAll the block sizes are still added up for the
+/// odd-number gate.
+static size_t scanBlockEdges(Function &F, const BuggyCheckTable &Table,
+                             BuggyScanState &State, bool CountAll) {
+  size_t InstCount = 0;
+  bool Stopped = false;
+  for (BasicBlock &BB : F) {
+    if (CountAll)
+      InstCount += BB.size();
+    if (Stopped)
+      continue;
+
+    for (PHINode &Phi : BB.phis()) {
+      if (!CountAll)
+        ++InstCount;
+      if (runTableChecks(Table, Phi, State)) {
+        Stopped = true;
+        break;
+      }
+    }
+
+    Instruction *Term = BB.getTerminator();
+    if (!Stopped && Term) {
+      if (!CountAll)
+        ++InstCount;
+      Stopped = runTableChecks(Table, *Term, State);
+    }
+
+    if (Stopped && !CountAll)
+      break;
+  }
+
+  return InstCount;
+}
+
+/// Version of scanFunction for the report option. Walks every instruction,
+/// also after a terminal event, and counts the constructs the report lists
+/// into State.Constructs, so the report needs no walk of its own. Without
+/// \p Table it only counts.
+static size_t scanFunctionReported(Function &F, const BuggyCheckTable *Table,
+                                   BuggyScanState &State) {
+  BuggyConstructCounts &Counts = State.Constructs.emplace();
+  bool Stopped = !Table;
+  for (Instruction &I : instructions(F)) {
+    ++Counts.Instructions;
+    if (isa<VectorType>(I.getType()))
+      ++Counts.VectorValues;
+
+    if (isa<ShuffleVectorInst>(I))
+      ++Counts.ShuffleVectors;
+    else if (auto *Load = dyn_cast<LoadInst>(&I))
+      Counts.IntToPtrLoads += isa<IntToPtrInst>(Load->getPointerOperand());
+    else if (auto *Store = dyn_cast<StoreInst>(&I))
+      Counts.ConstantExprStores +=
+          isa<ConstantExpr>(Store->getPointerOperand());
+    else if (auto *Switch = dyn_cast<SwitchInst>(&I))
+      Counts.OddSwitches += Switch->getNumCases() & 1;
+    else if (isa<SelectInst>(I))
+      Counts.I1Selects += I.getType()->isIntegerTy(1);
+    else if (auto *Call = dyn_cast<CallBase>(&I))
+      Counts.IndirectCalls += !Call->getCalledFunction();
+
+    if (!Stopped && runTableChecks(*Table, I, State))
+      Stopped = true;
+  }
+  return Counts.Instructions;
+}
+
+/// Run the checks in \p Mask on \p I, in the same order as the opcode table.
+template <unsigned Mask>
+static bool runInstChecks(Instruction &I, BuggyScanState &State) {
+  if constexpr ((Mask & CheckICmpSltToSle) != 0) {
+    if (isa<ICmpInst>(I) && checkICmpSltToSle(I, State))
+      return true;
+  }
+  if constexpr ((Mask & CheckSwitchOddNumberCases) != 0) {
+    if (isa<SwitchInst>(I) && checkSwitchOddNumberCases(I, State))
+      return true;
+  }
+  if constexpr ((Mask & CheckShuffleVector) != 0) {
+    if (isa<ShuffleVectorInst>(I) && checkShuffleVector(I, State))
+      return true;
+  }
+  if constexpr ((Mask & CheckVector) != 0) {
+    if (checkVector(I, State))
+      return true;
+  }
+  if constexpr ((Mask & PhiChecks) != 0) {
+    if (isa<PHINode>(I) && checkPhi<Mask & PhiChecks>(I, State))
+      return true;
+  }
+  if constexpr ((Mask & CheckI1Select) != 0) {
+    if (isa<SelectInst>(I) && checkI1Select(I, State))
+      return true;
+  }
+  if constexpr ((Mask & CheckStoreToConstantExpr) != 0) {
+    if (isa<StoreInst>(I) && checkStoreToConstantExpr(I, State))
+      return true;
+  }
+  if constexpr ((Mask & CheckLoadOfIntToPtr) != 0) {
+    if (isa<LoadInst>(I) && checkLoadOfIntToPtr(I, State))
+      return true;
+  }
+  if constexpr ((Mask & CheckIndirectCall) != 0) {
+    if (isa<CallBase>(I) && checkIndirectCall(I, State))
+      return true;
+  }
+  return false;
+}
+
+/// Version of scanFunction with the set of enabled checks fixed at compile
+/// time, so disabled checks generate no code in the loop.
+template <unsigned Mask>
+static size_t scanFunctionSpecialized(Function &F, const BuggyCheckTable &,
+                                      BuggyScanState &State, bool CountAll) {
+  size_t InstCount = 0;
+  bool Stopped = false;
+  for (BasicBlock &BB : F) {
+    for (Instruction &I : BB) {
+      ++InstCount;
+      if (!Stopped && runInstChecks<Mask>(I, State))
+        Stopped = true;
+    }
+
+    if (Stopped && !CountAll)
+      break;
+  }
+
+  return InstCount;
+}
+
+/// Pick the scan loop for \p InstChecks: the block edge walk if no check
+/// needs the bodies of blocks, a specialized loop for the check combinations
+/// used by the example interestingness scripts, or else the table-driven
+/// loop.
+static BuggyScanFn selectScanFn(unsigned InstChecks) {
+  if (InstChecks != 0 && (InstChecks & ~BlockEdgeChecks) == 0)
+    return scanBlockEdges;
+
+  switch (InstChecks) {
+  case CheckLoadOfIntToPtr:
+    return scanFunctionSpecialized<CheckLoadOfIntToPtr>;
+  case CheckIndirectCall:
+    return scanFunctionSpecialized<CheckIndirectCall>;
+  case CheckICmpSltToSle:
+    return scanFunctionSpecialized<CheckICmpSltToSle>;
+  case CheckI1Select | CheckPhiRepeatedPredecessor:
+    return scanFunctionSpecialized<CheckI1Select |
+                                   CheckPhiRepeatedPredecessor>;
+  default:
+    return scanFunction;
+  }
+}
+
+/// Bumped whenever the checks or the key change, so stale on-disk verdicts
+/// are ignored.
+static constexpr uint64_t BuggyVerdictVersion = 3;
+
+static uint64_t hashOptions(const BuggyOptions &Options) {
+  // The flags are hashed as printed, so the key does not depend on the order
+  // of BuggyOptions.def. Output paths do not change any verdict, so leave
+  // them out to let jobs writing to different files share the cache.
+  BuggyOptions Key = Options;
+  Key.SignatureFile.clear();
+  Key.ReportFile.clear();
+  Key.VerdictCacheDir.clear();
+
+  SmallString<256> Params;
+  raw_svector_ostream OS(Params);
+  Key.printParams(OS);
+  return xxh3_64bits(Params);
+}
+
+BuggyPass::BuggyPass(BuggyOptions Opts)
+    : Options(Opts), Checks(Opts), InstChecks(Opts.getInstCheckMask()),
+      Scan(selectScanFn(InstChecks)), OptionsHash(hashOptions(Opts)) {
+  if (!Options.ReportFile.empty())
+    Report = std::make_shared<BuggyReport>(Options.ReportFile);
+}
+
+/// Evaluate the probe predicates that only need a look at each block's first
+/// instruction and terminator, and return the instruction checks that can
+/// be ruled out for \p F.
+static unsigned probeInstChecks(Function &F, unsigned InstChecks,
+                                BuggyScanState &State) {
+  bool AnyPhi = false;
+  bool AnyOddSwitch = false;
+  for (BasicBlock &BB : F) {
+    AnyPhi |= !BB.empty() && isa<PHINode>(BB.front());
+    if (const auto *Switch = dyn_cast_or_null<SwitchInst>(BB.getTerminator()))
+      AnyOddSwitch |= (Switch->getNumCases() & 1) != 0;
+  }
+
+  unsigned RuledOut = 0;
+  if ((InstChecks & PhiChecks) && !AnyPhi) {
+    State.ProbeResults |= ProbeNoPhis;
+    RuledOut |= PhiChecks;
+  }
+  if ((InstChecks & CheckSwitchOddNumberCases) && !AnyOddSwitch) {
+    State.ProbeResults |= ProbeNoOddSwitch;
+    RuledOut |= CheckSwitchOddNumberCases;
+  }
+  return RuledOut;
+}
+
+/// Verdicts for functions the checks found nothing in, shared by every
+/// BuggyPass in the process and optionally kept on disk.
+///
+/// On disk, each process appends its verdicts to its own verdicts-<pid> file
+/// in the directory, one "<key> <verdict>" line each, and the files of all
+/// processes are read once, on first use. Verdicts other processes find
+/// later are not seen until the next process starts, which is fine for a
+/// reduction, where every candidate is a new process or a fork.
+class BuggyVerdictCache {
+  std::mutex Lock;
+  // Not a DenseMap, which reserves two keys a hash could collide with.
+  std::unordered_map<uint64_t, bool> Verdicts;
+
+  /// Directory whose files were read into Verdicts, and the file this
+  /// process appends to there. Out is reopened in a forked child, which must
+  /// not append to its parent's file.
+  std::string LoadedDir;
+  std::unique_ptr<raw_fd_ostream> Out;
+  sys::Process::Pid OutPid = 0;
+
+  static constexpr StringLiteral FilePrefix = "verdicts-";
+
+  void load(StringRef Dir) {
+    LoadedDir = Dir.str();
+    Out.reset();
+
+    std::error_code EC;
+    for (sys::fs::directory_iterator It(Dir, EC), End; It != End && !EC;
+         It.increment(EC)) {
+      if (!sys::path::filename(It->path()).starts_with(FilePrefix))
+        continue;
+      ErrorOr<std::unique_ptr<MemoryBuffer>> File =
+          MemoryBuffer::getFile(It->path(), /*IsText=*/false,
+                                /*RequiresNullTerminator=*/false);
+      if (!File)
+        continue;
+
+      // A process that crashed mid-write can leave a partial last line.
+      StringRef Rest = (*File)->getBuffer();
+      while (!Rest.empty()) {
+        StringRef Line;
+        std::tie(Line, Rest) = Rest.split('\n');
+        uint64_t Key;
+        if (Line.size() != 18 || Line[16] != ' ' ||
+            Line.take_front(16).getAsInteger(16, Key))
+          continue;
+        Verdicts.try_emplace(Key, Line[17] == '1');
+      }
+    }
+  }
+
+  void append(StringRef Dir, uint64_t Key, bool Verdict) {
+    const sys::Process::Pid Pid = sys::Process::getProcessId();
+    if (!Out || OutPid != Pid) {
+      SmallString<256> Path(Dir);
+      sys::path::append(Path, FilePrefix + Twine(Pid));
+      std::error_code EC;
+      Out = std::make_unique<raw_fd_ostream>(Path, EC, sys::fs::OF_Append);
+      if (EC) {
+        Out.reset();
+        return;
+      }
+      // Unbuffered, so a verdict is on disk before the pass crashes on the
+      // next function.
+      Out->SetUnbuffered();
+      OutPid = Pid;
+    }
+
+    // Written with a single write, so the line is either there or partial.
+    SmallString<20> Line;
+    raw_svector_ostream(Line) << format_hex_no_prefix(Key, 16) << ' '
+                              << (Verdict ? '1' : '0') << '\n';
+    *Out << Line;
+  }
+
+public:
+  static BuggyVerdictCache &get() {
+    static BuggyVerdictCache Cache;
+    return Cache;
+  }
+
+  std::optional<bool> lookup(uint64_t Key, StringRef Dir) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (!Dir.empty() && Dir != LoadedDir)
+      load(Dir);
+    auto It = Verdicts.find(Key);
+    if (It == Verdicts.end())
+      return std::nullopt;
+    return It->second;
+  }
+
+  void insert(uint64_t Key, bool Verdict, StringRef Dir) {
+    std::lock_guard<std::mutex> Guard(Lock);
+    if (!Dir.empty() && Dir != LoadedDir)
+      load(Dir);
+    if (Verdicts.try_emplace(Key, Verdict).second && !Dir.empty())
+      append(Dir, Key, Verdict);
+  }
+};
+
+uint64_t BuggyPass::getVerdictKey(Function &F,
+                                     const BuggyModuleInfo &Info) const {
+  bool HasWeakGlobal =
+      Options.hasCrashIfWeakGlobalExists() &&
+      (Info.Facts ? Info.Facts->HasWeakGlobal : hasWeakGlobal(*F.getParent()));
+
+  SmallVector<uint64_t, 64> Parts = {BuggyVerdictVersion,
+                                     OptionsHash,
+                                     StructuralHash(F, /*DetailedHash=*/true),
+                                     uint64_t(F.getLinkage()),
+                                     hasBuggyAttr(F, Info),
+                                     Info.GlobalStateModified,
+                                     HasWeakGlobal};
+
+  // StructuralHash covers the opcode, type and operand count of each
+  // instruction, which is enough for the vector, aggregate PHI and
+  // odd-number checks. It skips the incoming blocks of PHIs, though, and
+  // for operands other than constants and arguments only mixes in their
+  // type, so add what the other checks read. Incoming blocks are numbered in
+  // the order they are first seen, which is all a repeated predecessor
+  // needs. This is an order of magnitude cheaper than hashing the printed
+  // function.
+  DenseMap<const BasicBlock *, unsigned> IncomingBlocks;
+  for (Instruction &I : instructions(F)) {
+    if (auto *Phi = dyn_cast<PHINode>(&I)) {
+      for (unsigned Idx = 0, E = Phi->getNumIncomingValues(); Idx != E;
+           ++Idx) {
+        auto It = IncomingBlocks
+                      .try_emplace(Phi->getIncomingBlock(Idx),
+                                   IncomingBlocks.size())
+                      .first;
+        Parts.push_back(uint64_t(It->second) << 1 |
+                        (Phi->getIncomingValue(Idx) == Phi));
+      }
+    } else if (auto *Load = dyn_cast<LoadInst>(&I)) {
+      Parts.push_back(isa<IntToPtrInst>(Load->getPointerOperand()));
+    } else if (auto *Store = dyn_cast<StoreInst>(&I)) {
+      Parts.push_back(isa<ConstantExpr>(Store->getPointerOperand()));
+    } else if (auto *Switch = dyn_cast<SwitchInst>(&I)) {
+      Parts.push_back(Switch->getNumCases());
+    } else if (isa<SelectInst>(I)) {
+      Parts.push_back(I.getType()->isIntegerTy(1));
+    } else if (auto *Call = dyn_cast<CallBase>(&I)) {
+      Parts.push_back(!Call->getCalledFunction());
+    }
+  }
+
+  return xxh3_64bits(
+      ArrayRef<uint8_t>(reinterpret_cast<const uint8_t *>(Parts.data()),
+                        Parts.size() * sizeof(uint64_t)));
+}
+
+bool BuggyPass::isCacheableVerdict(const BuggyScanState &State) const {
+  // A cached verdict has no queued rewrites to apply, and the asm is inserted
+  // unconditionally, so neither can be replayed from the cache.
+  if (Options.hasMiscompileICmpSltToSle() || Options.hasInsertUnparseableAsm())
+    return false;
+  return State.Crash == BuggyBugKind::None && !State.Hang;
+}
+
+bool BuggyPass::analyze(Function &F, const BuggyModuleInfo &Info,
+                        BuggyScanState &State) const {
+  if (!Options.hasVerdictCache())
+    return analyzeUncached(F, Info, State);
+
+  BuggyVerdictCache &Cache = BuggyVerdictCache::get();
+  const uint64_t Key = getVerdictKey(F, Info);
+  if (std::optional<bool> Verdict = Cache.lookup(Key, Options.VerdictCacheDir)) {
+    State.CachedVerdict = true;
+    return *Verdict;
+  }
+
+  bool Affected = analyzeUncached(F, Info, State);
+  if (isCacheableVerdict(State))
+    Cache.insert(Key, Affected, Options.VerdictCacheDir);
+  return Affected;
+}
+
+bool BuggyPass::analyzeTimed(Function &F, const BuggyModuleInfo &Info,
+                             BuggyScanState &State) const {
+  if (!Report)
+    return analyze(F, Info, State);
+
+  auto Start = std::chrono::steady_clock::now();
+  bool Affected = analyze(F, Info, State);
+  State.CheckNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      std::chrono::steady_clock::now() - Start)
+                      .count();
+
+  // A function decided before the walk, by a gate, a pre-empting event or
+  // the verdict cache, still needs its constructs counted. That walk is not
+  // part of the check time.
+  if (!State.Constructs)
+    scanFunctionReported(F, nullptr, State);
+  return Affected;
+}
+
+bool BuggyPass::analyzeUncached(Function &F, const BuggyModuleInfo &Info,
+                                BuggyScanState &State) const {
+  if ((Options.hasBugOnlyIfInternalFunc() && !F.hasInternalLinkage()) ||
+      (Options.hasBugOnlyIfExternalFunc() && !F.hasExternalLinkage())) {
+    State.ProbeResults |= ProbeLinkage;
+    return false;
+  }
+
+  if (Options.hasCrashOnBuggyAttr() && hasBuggyAttr(F, Info))
+    return crash(State, BuggyBugKind::BuggyAttr);
+
+  if (Options.hasCrashOnBuggyGlobalState() && Info.GlobalStateModified)
+    return crash(State, BuggyBugKind::BuggyGlobalState);
+
+  // Events that pre-empt the per-instruction checks. If one applies, the walk
+  // only needs to produce the instruction count for the odd-number gate. In
+  // particular, no icmp slt is queued for rewriting with
+  // insert-unparseable-asm.
+  bool ScanChecks = !Options.hasInsertUnparseableAsm() && InstChecks != 0;
+  if (Options.hasCrashIfWeakGlobalExists() &&
+      (Info.Facts ? Info.Facts->HasWeakGlobal
+                  : hasWeakGlobal(*F.getParent()))) {
+    crash(State, BuggyBugKind::WeakGlobal);
+    ScanChecks = false;
+  }
+
+  if (Options.hasProbe()) {
+    if (InstChecks == 0)
+      State.ProbeResults |= ProbeNoInstChecks;
+    else if (ScanChecks &&
+             (InstChecks & ~probeInstChecks(F, InstChecks, State)) == 0) {
+      ScanChecks = false;
+      State.SkippedWalk = true;
+    }
+
+    // With no walk and no pre-empting event there is nothing for the
+    // odd-number gate to let through, so skip counting as well.
+    if (!ScanChecks && State.Crash == BuggyBugKind::None &&
+        !Options.hasInsertUnparseableAsm()) {
+      if (Options.hasBugOnlyIfOddNumberInsts())
+        State.ProbeResults |= ProbeNothingToGate;
+      return false;
+    }
+  }
+
+  const bool OddGate = Options.hasBugOnlyIfOddNumberInsts();
+
+  size_t InstCount = 0;
+  if (Report) {
+    InstCount = scanFunctionReported(F, ScanChecks ? &Checks : nullptr, State);
+  } else if (ScanChecks) {
+    InstCount = Scan(F, Checks, State, /*CountAll=*/OddGate);
+  } else if (OddGate) {
     for (BasicBlock &BB : F)
       InstCount += BB.size();
-    if ((InstCount & 1) == 0)
-      return PreservedAnalyses::all();
   }
 
-  if (Options.CrashIfWeakGlobalExists) {
-    for (const GlobalValue &GV : F.getParent()->globals()) {
-      if (GV.hasWeakLinkage())
-        report_fatal_error("broken if there is a weak global");
+  State.NumInsts = InstCount;
+  if (OddGate && (InstCount & 1) == 0) {
+    State.ProbeResults |= ProbeEvenInsts;
+    return false;
+  }
+  return true;
+}
+
+/// Add what was counted while checking one function to the statistics.
+static void recordStats(const BuggyScanState &State) {
+  static Statistic *const VisitedStats[NumInstChecks] = {
+#define BUGGY_OPTION(Field, Name)
+#define BUGGY_CHECK_OPTION(Field, Name, Check) &NumVisited##Check,
+#define BUGGY_BUG_CHECK_OPTION(Field, Name, Bug) &NumVisited##Bug,
+#include "BuggyOptions.def"
+  };
+
+  ++NumFunctionsChecked;
+  if (State.ProbeResults & ProbeLinkage)
+    ++NumSkippedByLinkage;
+  if (State.ProbeResults & ProbeEvenInsts)
+    ++NumSkippedByOddGate;
+  if (State.SkippedWalk)
+    ++NumWalksSkipped;
+  if (State.CachedVerdict)
+    ++NumCachedVerdicts;
+  NumInstsWalked += State.NumInsts;
+  for (unsigned I = 0; I != NumInstChecks; ++I) {
+    if (State.Visited[I])
+      *VisitedStats[I] += State.Visited[I];
+  }
+}
+
+/// Emit the probe summary for \p F as an analysis remark, visible with
+/// -pass-remarks-analysis=buggy.
+static void reportProbe(Function &F, const BuggyScanState &State) {
+  static const std::pair<BuggyProbePredicate, StringLiteral> Names[] = {
+      {ProbeLinkage, "linkage"},
+      {ProbeNoInstChecks, "no-inst-checks"},
+      {ProbeNoPhis, "no-phis"},
+      {ProbeNoOddSwitch, "no-odd-switch"},
+      {ProbeNothingToGate, "nothing-to-gate"},
+      {ProbeEvenInsts, "even-insts"}};
+
+  SmallString<64> RuledOutBy;
+  for (const auto &[Predicate, PredicateName] : Names) {
+    if (State.ProbeResults & Predicate) {
+      if (!RuledOutBy.empty())
+        RuledOutBy += ',';
+      RuledOutBy += PredicateName;
     }
   }
 
-  LLVMContext &Ctx = F.getContext();
+  OptimizationRemarkEmitter ORE(&F);
+  ORE.emit([&] {
+    OptimizationRemarkAnalysis R(DEBUG_TYPE, "Probe", F.getSubprogram(),
+                                 &F.getEntryBlock());
+    R << (State.SkippedWalk ? "skipped instruction walk" : "walked instructions");
+    if (!RuledOutBy.empty())
+      R << "; ruled out by " << ore::NV("Predicates", RuledOutBy);
+    return R;
+  });
+}
+
+BuggyReport::~BuggyReport() {
+  if (J) {
+    J->arrayEnd();
+    J.reset();
+    *OS << '\n';
+  }
+}
+
+void BuggyReport::write(Function &F, const BuggyScanState &State) {
+  if (Failed)
+    return;
+  if (!OS) {
+    std::error_code EC;
+    OS = std::make_unique<raw_fd_ostream>(Path, EC, sys::fs::OF_Text);
+    if (EC) {
+      errs() << "buggy: cannot write report '" << Path << "': " << EC.message()
+             << '\n';
+      Failed = true;
+      return;
+    }
+    J.emplace(*OS);
+    J->arrayBegin();
+  }
+
+  static const StringLiteral CheckNames[NumInstChecks] = {
+#define BUGGY_OPTION(Field, Name)
+#define BUGGY_CHECK_OPTION(Field, Name, Check) Name,
+#define BUGGY_BUG_CHECK_OPTION(Field, Name, Bug) Name,
+#include "BuggyOptions.def"
+  };
+
+  assert(State.Constructs && "constructs not counted for the report");
+  const BuggyConstructCounts &Counts = *State.Constructs;
+  J->object([&] {
+    J->attribute("function", F.getName());
+    J->attribute("instructions", int64_t(Counts.Instructions));
+    J->attribute("check_ns", int64_t(State.CheckNs));
+    J->attribute("bug", getBugKindName(State.Crash));
+    J->attribute("hang", State.Hang);
+    J->attribute("cached", State.CachedVerdict);
+    J->attributeObject("visited", [&] {
+      for (unsigned I = 0; I != NumInstChecks; ++I) {
+        if (State.Visited[I])
+          J->attribute(CheckNames[I], int64_t(State.Visited[I]));
+      }
+    });
+    J->attribute("shufflevectors", int64_t(Counts.ShuffleVectors));
+    J->attribute("vector_values", int64_t(Counts.VectorValues));
+    J->attribute("inttoptr_loads", int64_t(Counts.IntToPtrLoads));
+    J->attribute("constantexpr_stores", int64_t(Counts.ConstantExprStores));
+    J->attribute("odd_switches", int64_t(Counts.OddSwitches));
+    J->attribute("i1_selects", int64_t(Counts.I1Selects));
+    J->attribute("indirect_calls", int64_t(Counts.IndirectCalls));
+  });
+}
 
-  if (Options.InsertUnparseableAsm) {
+void BuggyPass::reportBug(BuggyBugKind Kind) const {
+  const unsigned ID = static_cast<unsigned>(Kind);
+  if (!Options.SignatureFile.empty()) {
+    std::error_code EC;
+    raw_fd_ostream OS(Options.SignatureFile, EC, sys::fs::OF_Text);
+    if (!EC)
+      OS << ID << ' ' << getBugKindName(Kind) << '\n';
+  }
+
+  if (Options.hasExitCode()) {
+    errs() << "buggy: " << getBugKindMessage(Kind) << '\n';
+    // Exit the way report_fatal_error does, which a CrashRecoveryContext in
+    // the embedding tool can intercept.
+    sys::Process::Exit(BuggyBugExitCodeBase + ID);
+  }
+  report_fatal_error(getBugKindMessage(Kind));
+}
+
+void BuggyPass::rewriteICmps(Function &F, ArrayRef<ICmpInst *> ICmps) {
+  OptimizationRemarkEmitter ORE(&F);
+  for (ICmpInst *ICmp : ICmps) {
+    const unsigned Site = NumSltSites++;
+    const bool Selected =
+        Site >= Options.MiscompileSkip &&
+        (Options.MiscompileCount == 0 ||
+         Site - Options.MiscompileSkip < Options.MiscompileCount);
+    if (!Selected) {
+      ORE.emit([&] {
+        return OptimizationRemarkMissed(DEBUG_TYPE, "MiscompileICmp", ICmp)
+               << "left icmp slt alone at site " << ore::NV("Site", Site);
+      });
+      continue;
+    }
+
+    ICmp->setPredicate(ICmpInst::ICMP_SLE);
+    ORE.emit([&] {
+      return OptimizationRemark(DEBUG_TYPE, "MiscompileICmp", ICmp)
+             << "rewrote icmp slt to sle at site " << ore::NV("Site", Site);
+    });
+  }
+}
+
+PreservedAnalyses BuggyPass::apply(Function &F, BuggyScanState &State) {
+  if (State.Crash != BuggyBugKind::None)
+    reportBug(State.Crash);
+
+  rewriteICmps(F, State.PendingRewrites);
+
+  if (Options.hasInsertUnparseableAsm()) {
+    LLVMContext &Ctx = F.getContext();
     BasicBlock &InsertBB = F.getEntryBlock();
     BasicBlock::iterator It = InsertBB.getFirstInsertionPt();
     FunctionType *FTy =
@@ -156,141 +1573,286 @@ PreservedAnalyses BuggyPass::run(Function &F, FunctionAnalysisManager &AM) {
     return PreservedAnalyses::none();
   }
 
-  for (BasicBlock &BB : F) {
-    for (Instruction &I : BB) {
+  if (State.Hang) {
+    if (Options.InfLoopMs == 0) {
+      while (true)
+        side_effect = 0;
+    }
 
-      if (ICmpInst *ICmp = dyn_cast<ICmpInst>(&I)) {
-        if (Options.MiscompileICmpSltToSle) {
-          if (ICmp->getPredicate() == ICmpInst::ICMP_SLT) {
-            ICmp->setPredicate(ICmpInst::ICMP_SLE);
-            Changed = true;
-          }
-        }
-      }
+    auto Deadline = std::chrono::steady_clock::now() +
+                    std::chrono::milliseconds(Options.InfLoopMs);
+    while (std::chrono::steady_clock::now() < Deadline)
+      side_effect = 0;
+    errs() << "buggy: infloop-on-indirect-call gave up after "
+           << Options.InfLoopMs << "ms\n";
+    sys::Process::Exit(BuggyHangExitCode);
+  }
 
-      if (Options.CrashOnSwitchOddNumberCases) {
-        if (const auto *Switch = dyn_cast<SwitchInst>(&I)) {
-          if (Switch->getNumCases() & 1)
-            report_fatal_error("switch with odd number of cases is broken");
-        }
-      }
+  // Every visited instruction counts as a change.
+  return F.empty() ? PreservedAnalyses::all() : PreservedAnalyses::none();
+}
 
-      if (Options.CrashOnShuffleVector && isa<ShuffleVectorInst>(I))
-        report_fatal_error("shufflevector instructions are broken");
+PreservedAnalyses BuggyPass::run(Function &F, FunctionAnalysisManager &AM) {
+  clearSignature();
 
-      if (Options.CrashOnVector && isa<VectorType>(I.getType()))
-        report_fatal_error("vector instructions are broken");
+  Module &M = *F.getParent();
+  const auto &MAMProxy = AM.getResult<ModuleAnalysisManagerFunctionProxy>(F);
 
-      if (PHINode *Phi = dyn_cast<PHINode>(&I)) {
-        if (Options.CrashOnPhiRepeatedPredecessor) {
-          SmallPtrSet<BasicBlock *, 4> VisitedPreds;
-          for (BasicBlock *Pred : Phi->blocks()) {
-            if (!VisitedPreds.insert(Pred).second)
-              report_fatal_error("phi with repeated predecessor is broken");
-          }
-        }
+  BuggyModuleInfo Info;
+  Info.Facts = MAMProxy.getCachedResult<BuggyModuleAnalysis>(M);
+  if (const auto *GlobalState =
+          MAMProxy.getCachedResult<BuggyGlobalStateAnalysis>(M))
+    Info.GlobalStateModified = GlobalState->isModified();
 
-        if (Options.CrashOnPhiSelfReference) {
-          for (Value *Incoming : Phi->incoming_values()) {
-            if (Incoming == Phi)
-              report_fatal_error("self referential phi is broken");
-          }
-        }
+  TimeTraceScope TimeScope("BuggyPass", F.getName());
 
-        if (Options.CrashOnAggregatePhi && Phi->getType()->isAggregateType())
-          report_fatal_error("aggregate phis are broken");
-      }
+  BuggyScanState State;
+  bool Affected;
+  {
+    NamedRegionTimer T("analyze", "Check function", PassName,
+                       "Buggy plugin", TimePassesIsEnabled);
+    Affected = analyzeTimed(F, Info, State);
+  }
+  recordStats(State);
+  if (Options.hasProbe())
+    reportProbe(F, State);
+  report(F, State);
+  if (!Affected || Options.hasDryRun())
+    return PreservedAnalyses::all();
+  return apply(F, State);
+}
 
-      if (Options.CrashOnI1Select) {
-        if (const auto *SI = dyn_cast<SelectInst>(&I))
-          if (SI->getType()->isIntegerTy(1))
-            report_fatal_error("i1 typed select is broken");
-      }
+PreservedAnalyses BuggyParallelPass::run(Module &M, ModuleAnalysisManager &AM) {
+  Impl.clearSignature();
 
-      if (Options.CrashOnStoreToConstantExpr) {
-        if (const auto *SI = dyn_cast<StoreInst>(&I)) {
-          if (isa<ConstantExpr>(SI->getPointerOperand()))
-            report_fatal_error("store to constantexpr pointer is broken");
-        }
-      }
+  // Computed directly rather than through the analysis manager, which is not
+  // safe to query from the worker threads.
+  const BuggyModuleAnalysis::Result Facts = BuggyModuleAnalysis().run(M, AM);
 
-      if (Options.CrashOnLoadOfIntToPtr) {
-        auto *LI = dyn_cast<LoadInst>(&I);
-        if (LI && isa<IntToPtrInst>(LI->getPointerOperand()))
-          report_fatal_error("load of inttoptr is broken");
-      }
+  BuggyModuleInfo Info;
+  Info.Facts = &Facts;
+  if (const auto *GlobalState =
+          AM.getCachedResult<BuggyGlobalStateAnalysis>(M))
+    Info.GlobalStateModified = GlobalState->isModified();
 
-      if (Options.InfLoopOnIndirectCall) {
-        auto *CI = dyn_cast<CallBase>(&I);
-        while (CI && !CI->getCalledFunction())
-          side_effect = 0;
-      }
+  SmallVector<Function *, 0> Funcs;
+  for (Function &F : M) {
+    if (!F.isDeclaration())
+      Funcs.push_back(&F);
+  }
 
-      Changed = true;
+  // Only read the IR on the worker threads. Anything that modifies it is left
+  // to the serial phase below.
+  std::vector<BuggyScanState> States(Funcs.size());
+  std::vector<char> Affected(Funcs.size());
+  {
+    TimeTraceScope TimeScope("BuggyParallelPass", M.getName());
+    NamedRegionTimer T("analyze", "Check function", PassName, "Buggy plugin",
+                       TimePassesIsEnabled);
+    DefaultThreadPool Pool(hardware_concurrency(Threads));
+    for (size_t I = 0, E = Funcs.size(); I != E; ++I) {
+      Pool.async([&, I] {
+        Affected[I] = Impl.analyzeTimed(*Funcs[I], Info, States[I]);
+      });
     }
+    Pool.wait();
+  }
+
+  // Act on the results in module order, so the failure reported is the one a
+  // serial run of buggy would have hit first.
+  bool Changed = false;
+  for (size_t I = 0, E = Funcs.size(); I != E; ++I) {
+    recordStats(States[I]);
+    if (Impl.getOptions().hasProbe())
+      reportProbe(*Funcs[I], States[I]);
+    Impl.report(*Funcs[I], States[I]);
+    if (Affected[I] && !Impl.getOptions().hasDryRun())
+      Changed |= !Impl.apply(*Funcs[I], States[I]).areAllPreserved();
   }
 
   return Changed ? PreservedAnalyses::none() : PreservedAnalyses::all();
 }
 
+/// Check that \p Path, given to the buggy parameter \p Param, can be
+/// printed back into a pipeline. The pipeline parser splits on ',', '(' and
+/// ')', and '<' and '>' would unbalance the parameter list; ';' never gets
+/// this far.
+static Error checkPathParam(StringRef Param, StringRef Path) {
+  if (Path.find_first_of(",()<>") == StringRef::npos)
+    return Error::success();
+  return make_error<StringError>(
+      formatv("invalid buggy {0} path '{1}', which cannot contain any of "
+              "',()<>'",
+              Param, Path)
+          .str(),
+      inconvertibleErrorCode());
+}
+
 static Expected<BuggyOptions> parseBuggyOptions(StringRef Params) {
   if (Params.empty())
     return BuggyOptions();
 
   BuggyOptions Result;
   while (!Params.empty()) {
-    StringRef ParamName;
-    std::tie(ParamName, Params) = Params.split(';');
+    StringRef Token;
+    std::tie(Token, Params) = Params.split(';');
+
+    StringRef ParamName = Token;
+    if (ParamName.consume_front("infloop-ms=")) {
+      if (ParamName.getAsInteger(0, Result.InfLoopMs)) {
+        return make_error<StringError>(
+            formatv("invalid buggy infloop-ms value '{0}'", ParamName).str(),
+            inconvertibleErrorCode());
+      }
+      continue;
+    }
+
+    if (ParamName.consume_front("miscompile-skip=")) {
+      if (ParamName.getAsInteger(0, Result.MiscompileSkip)) {
+        return make_error<StringError>(
+            formatv("invalid buggy miscompile-skip value '{0}'", ParamName)
+                .str(),
+            inconvertibleErrorCode());
+      }
+      continue;
+    }
+
+    if (ParamName.consume_front("miscompile-count=")) {
+      if (ParamName.getAsInteger(0, Result.MiscompileCount)) {
+        return make_error<StringError>(
+            formatv("invalid buggy miscompile-count value '{0}'", ParamName)
+                .str(),
+            inconvertibleErrorCode());
+      }
+      continue;
+    }
+
+    if (ParamName.consume_front("signature-file=")) {
+      if (Error E = checkPathParam("signature-file", ParamName))
+        return std::move(E);
+      Result.SignatureFile = ParamName.str();
+      continue;
+    }
+
+    if (ParamName.consume_front("verdict-cache-dir=")) {
+      if (Error E = checkPathParam("verdict-cache-dir", ParamName))
+        return std::move(E);
+      Result.set(BuggyOptions::VerdictCache, true);
+      Result.VerdictCacheDir = ParamName.str();
+      continue;
+    }
+
+    if (ParamName.consume_front("buggy-phase=")) {
+      if (parsePhases(ParamName, Result.BuggyPhases)) {
+        return make_error<StringError>(
+            formatv("invalid buggy buggy-phase value '{0}'", ParamName).str(),
+            inconvertibleErrorCode());
+      }
+      continue;
+    }
+
+    if (ParamName.consume_front("buggy-attr-phase=")) {
+      if (parsePhases(ParamName, Result.BuggyAttrPhases)) {
+        return make_error<StringError>(
+            formatv("invalid buggy buggy-attr-phase value '{0}'", ParamName)
+                .str(),
+            inconvertibleErrorCode());
+      }
+      continue;
+    }
+
+    if (ParamName.consume_front("report=")) {
+      if (Error E = checkPathParam("report", ParamName))
+        return std::move(E);
+      Result.set(BuggyOptions::DryRun, true);
+      Result.ReportFile = ParamName.str();
+      continue;
+    }
 
     bool Enable = !ParamName.consume_front("no-");
-    if (ParamName == "crash-on-vector")
-      Result.CrashOnVector = Enable;
-    else if (ParamName == "crash-on-shufflevector")
-      Result.CrashOnShuffleVector = Enable;
-    else if (ParamName == "crash-on-aggregate-phi")
-      Result.CrashOnAggregatePhi = Enable;
-    else if (ParamName == "crash-on-repeated-phi-predecessor")
-      Result.CrashOnPhiRepeatedPredecessor = Enable;
-    else if (ParamName == "crash-on-phi-self-reference")
-      Result.CrashOnPhiSelfReference = Enable;
-    else if (ParamName == "crash-load-of-inttoptr")
-      Result.CrashOnLoadOfIntToPtr = Enable;
-    else if (ParamName == "crash-store-to-constantexpr")
-      Result.CrashOnStoreToConstantExpr = Enable;
-    else if (ParamName == "crash-switch-odd-number-cases")
-      Result.CrashOnSwitchOddNumberCases = Enable;
-    else if (ParamName == "crash-on-i1-select")
-      Result.CrashOnI1Select = Enable;
-    else if (ParamName == "crash-if-weak-global-exists")
-      Result.CrashIfWeakGlobalExists = Enable;
-    else if (ParamName == "infloop-on-indirect-call")
-      Result.InfLoopOnIndirectCall = Enable;
-    else if (ParamName == "bug-only-if-odd-number-insts")
-      Result.BugOnlyIfOddNumberInsts = Enable;
-    else if (ParamName == "bug-only-if-internal-func")
-      Result.BugOnlyIfInternalFunc = Enable;
-    else if (ParamName == "bug-only-if-external-func")
-      Result.BugOnlyIfExternalFunc = Enable;
-    else if (ParamName == "insert-unparseable-asm")
-      Result.InsertUnparseableAsm = Enable;
-    else if (ParamName == "miscompile-icmp-slt-to-sle")
-      Result.MiscompileICmpSltToSle = Enable;
-    else if (ParamName == "crash-on-buggy-attr")
-      Result.CrashOnBuggyAttr = Enable;
-    else if (ParamName == "crash-on-buggy-global-state")
-      Result.CrashOnBuggyGlobalState = Enable;
-    else {
+    uint64_t Option = StringSwitch<uint64_t>(ParamName)
+#define BUGGY_OPTION(Field, Name) .Case(Name, BuggyOptions::Field)
+#include "BuggyOptions.def"
+                          .Default(0);
+    if (!Option) {
       return make_error<StringError>(
-          formatv("invalid buggy pass parameter '{0}'", Params).str(),
+          formatv("invalid buggy pass parameter '{0}'", Token).str(),
           inconvertibleErrorCode());
     }
+    Result.set(Option, Enable);
   }
 
   return Result;
 }
 
+static Expected<BuggyParallelOptions>
+parseBuggyParallelOptions(StringRef Params) {
+  BuggyParallelOptions Result;
+  SmallString<128> CheckParams;
+  while (!Params.empty()) {
+    StringRef ParamName;
+    std::tie(ParamName, Params) = Params.split(';');
+
+    if (ParamName.consume_front("threads=")) {
+      if (ParamName.getAsInteger(0, Result.Threads)) {
+        return make_error<StringError>(
+            formatv("invalid buggy-parallel thread count '{0}'", ParamName)
+                .str(),
+            inconvertibleErrorCode());
+      }
+      continue;
+    }
+
+    if (!CheckParams.empty())
+      CheckParams += ';';
+    CheckParams += ParamName;
+  }
+
+  Expected<BuggyOptions> Options = parseBuggyOptions(CheckParams);
+  if (!Options)
+    return Options.takeError();
+  Result.Options = *Options;
+  return Result;
+}
+
+/// Return the options from BUGGY_PLUGIN_OPTS, or null if it is not set. The
+/// variable is read and validated once per process, however many pipelines
+/// the plugin ends up being added to.
+static const BuggyOptions *getEnvBuggyOptions() {
+  struct EnvOptions {
+    std::optional<BuggyOptions> Options;
+    std::string Error;
+  };
+
+  static const EnvOptions Cached = [] {
+    EnvOptions Result;
+    if (std::optional<std::string> PassPipelineOpts =
+            sys::Process::GetEnv("BUGGY_PLUGIN_OPTS")) {
+      Expected<BuggyOptions> Options = parseBuggyOptions(*PassPipelineOpts);
+      if (Options)
+        Result.Options = *Options;
+      else
+        Result.Error = toString(Options.takeError());
+    }
+    return Result;
+  }();
+
+  if (!Cached.Error.empty())
+    report_fatal_error(Twine(Cached.Error), false);
+  return Cached.Options ? &*Cached.Options : nullptr;
+}
+
 PreservedAnalyses BuggyAttrPass::run(Module &M, ModuleAnalysisManager &AM) {
-  BuggyGlobalFlag = true;
+  AM.getResult<BuggyGlobalStateAnalysis>(M).setModified();
+
+  if (UseModuleFlag) {
+    if (!hasBuggyAttrFlag(M))
+      M.addModuleFlag(Module::Max, "buggy-attr", 1);
+    // The module facts record whether the flag is set.
+    PreservedAnalyses PA = PreservedAnalyses::all();
+    PA.abandon<BuggyModuleAnalysis>();
+    return PA;
+  }
 
   for (Function &F : M) {
     if (!F.isDeclaration())
@@ -300,22 +1862,84 @@ PreservedAnalyses BuggyAttrPass::run(Module &M, ModuleAnalysisManager &AM) {
   return PreservedAnalyses::all();
 }
 
+void BuggyAttrPass::printPipeline(
+    raw_ostream &OS, function_ref<StringRef(StringRef)> MapClassName2PassName) {
+  static_cast<PassInfoMixin<BuggyAttrPass> *>(this)->printPipeline(
+      OS, MapClassName2PassName);
+  if (UseModuleFlag)
+    OS << "<module-flag>";
+}
+
+static Expected<bool> parseBuggyAttrOptions(StringRef Params) {
+  if (Params.empty())
+    return false;
+  if (Params == "module-flag")
+    return true;
+  return make_error<StringError>(
+      formatv("invalid buggy-attr pass parameter '{0}'", Params).str(),
+      inconvertibleErrorCode());
+}
+
+static bool hasUnreachableBlock(Function &F) {
+  df_iterator_default_set<BasicBlock *> Reachable;
+  for (BasicBlock *BB : depth_first_ext(&F, Reachable))
+    (void)BB;
+  return Reachable.size() != F.size();
+}
+
+PreservedAnalyses BuggyUnreachableCheckPass::run(Module &M,
+                                                 ModuleAnalysisManager &AM) {
+  bool HasDefinition = false;
+  for (Function &F : M) {
+    if (F.isDeclaration())
+      continue;
+    HasDefinition = true;
+    if (hasUnreachableBlock(F))
+      sys::Process::Exit(BuggyUnreachableFoundExitCode);
+  }
+
+  if (!HasDefinition)
+    sys::Process::Exit(BuggyNoDefinedFunctionsExitCode);
+  return PreservedAnalyses::all();
+}
+
+/// Add the module passes BUGGY_PLUGIN_OPTS asks for in \p Phase. The
+/// vectorizer start callback is not told the phase, so with buggy-phase
+/// BuggyPass is added here instead, at the start of the optimization
+/// pipeline, rather than at the start of the vectorizer.
+static void addEnvModulePasses(ModulePassManager &PM,
+                               ThinOrFullLTOPhase Phase) {
+  const BuggyOptions *Options = getEnvBuggyOptions();
+  if (!Options)
+    return;
+  if (Options->needBuggyAttrPass() && Options->runsBuggyAttrIn(Phase))
+    PM.addPass(BuggyAttrPass(Options->hasBuggyAttrModuleFlag()));
+  if (!Options->runsBuggyIn(Phase))
+    return;
+  if (Options->needModuleFacts())
+    addBuggyModuleFacts(PM);
+  if (Options->BuggyPhases != BuggyOptions::DefaultPhases)
+    PM.addPass(createModuleToFunctionPassAdaptor(BuggyPass(*Options)));
+}
+
 static llvm::PassPluginLibraryInfo getBuggyPluginInfo() {
   return {LLVM_PLUGIN_API_VERSION, "BuggyPlugin", LLVM_VERSION_STRING,
           [](PassBuilder &PB) {
+            if (PassInstrumentationCallbacks *PIC =
+                    PB.getPassInstrumentationCallbacks())
+              PIC->addClassToPassName(BuggyModuleAnalysis::name(),
+                                      ModuleFactsName);
+            PB.registerAnalysisRegistrationCallback(
+                [](ModuleAnalysisManager &MAM) {
+                  MAM.registerPass([] { return BuggyModuleAnalysis(); });
+                  MAM.registerPass([] { return BuggyGlobalStateAnalysis(); });
+                });
             PB.registerVectorizerStartEPCallback(
                 [](llvm::FunctionPassManager &PM, OptimizationLevel Level) {
-                  if (std::optional<std::string> PassPipelineOpts =
-                          sys::Process::GetEnv("BUGGY_PLUGIN_OPTS")) {
-
-                    Expected<BuggyOptions> Options =
-                        parseBuggyOptions(*PassPipelineOpts);
-                    if (Options) {
+                  if (const BuggyOptions *Options = getEnvBuggyOptions()) {
+                    if (Options->BuggyPhases == BuggyOptions::DefaultPhases)
                       PM.addPass(BuggyPass(*Options));
-                      return true;
-                    }
-
-                    report_fatal_error(Options.takeError(), false);
+                    return true;
                   }
 
                   PM.addPass(BuggyPass());
@@ -335,22 +1959,58 @@ static llvm::PassPluginLibraryInfo getBuggyPluginInfo() {
                   return false;
                 });
 
-            PB.registerOptimizerEarlyEPCallback([](ModulePassManager &PM,
-                                                   OptimizationLevel,
-                                                   ThinOrFullLTOPhase) {
-              if (std::optional<std::string> PassPipelineOpts =
-                      sys::Process::GetEnv("BUGGY_PLUGIN_OPTS")) {
-                Expected<BuggyOptions> Options =
-                    parseBuggyOptions(*PassPipelineOpts);
-                if (Options && Options->needBuggyAttrPass())
-                  PM.addPass(BuggyAttrPass());
-              }
-            });
+            PB.registerOptimizerEarlyEPCallback(
+                [](ModulePassManager &PM, OptimizationLevel,
+                   ThinOrFullLTOPhase Phase) {
+                  addEnvModulePasses(PM, Phase);
+                });
+            PB.registerFullLinkTimeOptimizationEarlyEPCallback(
+                [](ModulePassManager &PM, OptimizationLevel) {
+                  addEnvModulePasses(PM, ThinOrFullLTOPhase::FullLTOPostLink);
+                });
             PB.registerPipelineParsingCallback(
                 [](StringRef Name, ModulePassManager &PM,
                    ArrayRef<llvm::PassBuilder::PipelineElement>) {
-                  if (Name == "buggy-attr") {
-                    PM.addPass(BuggyAttrPass());
+                  if (PassBuilder::checkParametrizedPassName(Name,
+                                                             "buggy-attr")) {
+                    auto Params = PassBuilder::parsePassParameters(
+                        parseBuggyAttrOptions, Name, "buggy-attr");
+                    if (!Params)
+                      return false;
+                    PM.addPass(BuggyAttrPass(*Params));
+                    return true;
+                  }
+
+                  if (parseAnalysisUtilityPasses<BuggyModuleAnalysis>(
+                          ModuleFactsName, Name, PM))
+                    return true;
+
+                  if (Name == "buggy-unreachable-check") {
+                    PM.addPass(BuggyUnreachableCheckPass());
+                    return true;
+                  }
+
+                  // At module level, compute the module facts up front so the
+                  // per-function pass can use the cached result.
+                  if (PassBuilder::checkParametrizedPassName(Name, PassName)) {
+                    auto Params = PassBuilder::parsePassParameters(
+                        parseBuggyOptions, Name, PassName);
+                    if (!Params)
+                      return false;
+                    if (Params->needModuleFacts())
+                      addBuggyModuleFacts(PM);
+                    PM.addPass(createModuleToFunctionPassAdaptor(
+                        BuggyPass(*Params)));
+                    return true;
+                  }
+
+                  if (PassBuilder::checkParametrizedPassName(
+                          Name, "buggy-parallel")) {
+                    auto Params = PassBuilder::parsePassParameters(
+                        parseBuggyParallelOptions, Name, "buggy-parallel");
+                    if (!Params)
+                      return false;
+                    PM.addPass(BuggyParallelPass(*Params));
                     return true;
                   }
 
@@ -0,0 +1,290 @@
+#!/usr/bin/env python3
+"""Reduce a crashing opt pass pipeline, testing several candidates at once.
+
+Works like llvm/utils/reduce_pipeline.py: the pipeline is expanded with
+-print-pipeline-passes, and passes are removed for as long as opt keeps
+failing with the exit code of the original pipeline. Instead of trying one
+candidate at a time, the passes are split into chunks and every candidate
+built from dropping (or keeping only) one chunk is run on its own job, in
+the manner of delta debugging. Results are cached by pipeline text, so a
+candidate reached twice is only run once.
+
+Any arguments not recognized here, such as --load-pass-plugin, are passed to
+opt unchanged, and opt inherits the environment, so BUGGY_PLUGIN_OPTS works
+as it does for a single opt run.
+
+Usage:
+  reduce_pipeline_parallel.py --opt-binary=opt --passes='default<O2>' \\
+      --input=input.ll -j 16 --load-pass-plugin=/path/to/plugin
+"""
+
+import argparse
+import concurrent.futures
+import json
+import os
+import subprocess
+import sys
+import threading
+
+
+class Pass:
+    """One element of a pass pipeline, with any nested pipeline."""
+
+    def __init__(self, name, children=None):
+        self.name = name
+        self.children = children
+
+    def __str__(self):
+        if self.children is None:
+            return self.name
+        return '%s(%s)' % (self.name, ','.join(map(str, self.children)))
+
+
+def parse_pipeline(text):
+    """Parse pipeline text into a list of Pass."""
+    pos = 0
+
+    def parse_list():
+        nonlocal pos
+        passes = []
+        while True:
+            start = pos
+            depth = 0
+            while pos < len(text):
+                c = text[pos]
+                if c == '<':
+                    depth += 1
+                elif c == '>':
+                    depth -= 1
+                elif depth == 0 and c in '(),':
+                    break
+                pos += 1
+            name = text[start:pos].strip()
+            if not name:
+                raise ValueError('empty pass name at offset %d in %r' %
+                                 (start, text))
+            children = None
+            if pos < len(text) and text[pos] == '(':
+                pos += 1
+                children = parse_list()
+                if pos >= len(text) or text[pos] != ')':
+                    raise ValueError('unbalanced parentheses in %r' % text)
+                pos += 1
+            passes.append(Pass(name, children))
+            if pos < len(text) and text[pos] == ',':
+                pos += 1
+                continue
+            return passes
+
+    passes = parse_list()
+    if pos != len(text):
+        raise ValueError('unexpected %r at offset %d in %r' %
+                         (text[pos], pos, text))
+    return passes
+
+
+def count_leaves(passes):
+    return sum(1 if p.children is None else count_leaves(p.children)
+               for p in passes)
+
+
+def keep_leaves(passes, keep, first=0):
+    """Return a copy of passes with only the leaves whose index is in keep.
+
+    Leaves are numbered in pipeline order starting at first. Pass managers and
+    adaptors left empty are dropped as well. Returns the new list and the
+    index after the last leaf."""
+    result = []
+    index = first
+    for p in passes:
+        if p.children is None:
+            if index in keep:
+                result.append(p)
+            index += 1
+            continue
+        children, index = keep_leaves(p.children, keep, index)
+        if children:
+            result.append(Pass(p.name, children))
+    return result, index
+
+
+def to_str(passes):
+    return ','.join(map(str, passes))
+
+
+class Oracle:
+    """Runs opt on candidate pipelines, remembering every verdict."""
+
+    def __init__(self, args, extra_opt_args):
+        self.args = args
+        self.extra_opt_args = extra_opt_args
+        self.expected = None
+        self.lock = threading.Lock()
+        self.verdicts = {}
+        self.runs = 0
+
+    def cache_key(self):
+        # Verdicts only carry over between runs reducing the same thing.
+        return [
+            self.args.opt_binary, self.args.input, self.extra_opt_args,
+            os.environ.get('BUGGY_PLUGIN_OPTS', ''), self.expected
+        ]
+
+    def load(self):
+        if not self.args.cache_file or not os.path.exists(self.args.cache_file):
+            return
+        with open(self.args.cache_file) as f:
+            cache = json.load(f)
+        if cache.get('key') == self.cache_key():
+            self.verdicts = cache['verdicts']
+
+    def run(self, pipeline):
+        cmd = [
+            self.args.opt_binary, '-disable-symbolication', '-disable-output',
+            '-passes=' + pipeline, self.args.input
+        ] + self.extra_opt_args
+        try:
+            return subprocess.run(cmd,
+                                  stdout=subprocess.DEVNULL,
+                                  stderr=subprocess.DEVNULL,
+                                  timeout=self.args.timeout or None).returncode
+        except subprocess.TimeoutExpired:
+            return 'timeout'
+
+    def is_interesting(self, pipeline):
+        with self.lock:
+            if pipeline in self.verdicts:
+                return self.verdicts[pipeline]
+        result = self.run(pipeline) == self.expected
+        with self.lock:
+            self.runs += 1
+            self.verdicts[pipeline] = result
+        return result
+
+    def save(self):
+        if self.args.cache_file:
+            with open(self.args.cache_file, 'w') as f:
+                json.dump({'key': self.cache_key(), 'verdicts': self.verdicts},
+                          f)
+
+
+def expand_pipeline(args, extra_opt_args):
+    """Return the pipeline opt actually builds for args.passes."""
+    cmd = [
+        args.opt_binary, '-disable-output', '-print-pipeline-passes',
+        '-passes=' + args.passes, args.input
+    ] + extra_opt_args
+    p = subprocess.run(cmd, capture_output=True, text=True)
+    if p.returncode != 0:
+        return None
+    lines = p.stdout.splitlines()
+    return lines[0].strip() if lines else None
+
+
+def split(items, n):
+    """Split items into n contiguous chunks of near equal size."""
+    size, rest = divmod(len(items), n)
+    chunks = []
+    start = 0
+    for i in range(n):
+        end = start + size + (1 if i < rest else 0)
+        chunks.append(items[start:end])
+        start = end
+    return chunks
+
+
+def reduce(passes, oracle, pool):
+    """Delta debug the leaves of passes, returning the smallest pipeline
+    found that is still interesting."""
+    current = list(range(count_leaves(passes)))
+    n = 2
+    while len(current) >= 2:
+        chunks = split(current, n)
+        # Keeping a single chunk is tried before dropping one, since it
+        # shrinks the pipeline the most. With two chunks both sets coincide.
+        subsets = chunks if n > 2 else []
+        complements = []
+        for chunk in chunks:
+            dropped = set(chunk)
+            complements.append([i for i in current if i not in dropped])
+        candidates = subsets + complements
+        pipelines = [to_str(keep_leaves(passes, set(c))[0]) for c in candidates]
+        results = list(pool.map(oracle.is_interesting, pipelines))
+
+        # Take the first interesting candidate in order, not whichever
+        # finished first, so the result does not depend on the job count.
+        found = next((i for i, r in enumerate(results) if r), None)
+        if found is not None:
+            current = candidates[found]
+            n = 2 if found < len(subsets) else max(n - 1, 2)
+            print('  %d passes left' % len(current), file=sys.stderr)
+            continue
+
+        if n >= len(current):
+            break
+        n = min(n * 2, len(current))
+
+    return to_str(keep_leaves(passes, set(current))[0])
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__.splitlines()[0],
+        usage='%(prog)s [options] [opt arguments]')
+    parser.add_argument('--opt-binary', required=True,
+                        help='Path to opt')
+    parser.add_argument('--passes', required=True,
+                        help='The pipeline to reduce')
+    parser.add_argument('--input', required=True,
+                        help='The IR file the pipeline fails on')
+    parser.add_argument('--output',
+                        help='Write the reduced pipeline to this file')
+    parser.add_argument('-j', '--jobs', type=int, default=0,
+                        help='Candidates to test at once (0 for one per core)')
+    parser.add_argument('--timeout', type=float, default=0,
+                        help='Seconds after which a candidate run counts as '
+                        'hanging (0 for no limit)')
+    parser.add_argument('--cache-file',
+                        help='Load and save verdicts in this JSON file, so '
+                        'repeated runs share them')
+    parser.add_argument('--dont-expand-passes', action='store_true',
+                        help='Reduce the pipeline as given rather than the '
+                        'one opt expands it to')
+    args, extra_opt_args = parser.parse_known_args()
+
+    oracle = Oracle(args, extra_opt_args)
+    oracle.expected = oracle.run(args.passes)
+    if oracle.expected == 0:
+        print('The original pipeline succeeded, nothing to reduce',
+              file=sys.stderr)
+        return 1
+    print('Original pipeline fails with %s' % oracle.expected, file=sys.stderr)
+    oracle.load()
+
+    pipeline = args.passes
+    if not args.dont_expand_passes:
+        expanded = expand_pipeline(args, extra_opt_args)
+        if expanded and oracle.is_interesting(expanded):
+            pipeline = expanded
+        else:
+            print('Expanded pipeline does not reproduce, reducing %r as given'
+                  % args.passes, file=sys.stderr)
+
+    passes = parse_pipeline(pipeline)
+    print('Reducing %d passes' % count_leaves(passes), file=sys.stderr)
+
+    jobs = args.jobs or os.cpu_count() or 1
+    with concurrent.futures.ThreadPoolExecutor(max_workers=jobs) as pool:
+        reduced = reduce(passes, oracle, pool)
+    oracle.save()
+
+    print('Ran opt %d times' % oracle.runs, file=sys.stderr)
+    print(reduced)
+    if args.output:
+        with open(args.output, 'w') as f:
+            f.write(reduced + '\n')
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
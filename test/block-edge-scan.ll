@@ -0,0 +1,78 @@
+; With only PHI and switch checks enabled, buggy visits just the leading
+; PHIs and the terminator of each block. Adding crash-on-shufflevector,
+; which never fires here, forces the walk over every instruction; both must
+; report the same first error, with and without the odd-number gate, which
+; needs the size of every block.
+
+; RUN: not --crash %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-aggregate-phi;crash-on-repeated-phi-predecessor;crash-on-phi-self-reference;crash-switch-odd-number-cases;bug-only-if-odd-number-insts;signature-file=%t.edge>'
+; RUN: not --crash %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-aggregate-phi;crash-on-repeated-phi-predecessor;crash-on-phi-self-reference;crash-switch-odd-number-cases;bug-only-if-odd-number-insts;crash-on-shufflevector;signature-file=%t.full>'
+; RUN: diff %t.edge %t.full
+; RUN: FileCheck --check-prefix=ALL --input-file=%t.edge %s
+
+; RUN: not --crash %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-aggregate-phi;crash-on-phi-self-reference;bug-only-if-odd-number-insts;signature-file=%t.edge>'
+; RUN: not --crash %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-aggregate-phi;crash-on-phi-self-reference;bug-only-if-odd-number-insts;crash-on-shufflevector;signature-file=%t.full>'
+; RUN: diff %t.edge %t.full
+; RUN: FileCheck --check-prefix=PHI --input-file=%t.edge %s
+
+; RUN: not --crash %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-aggregate-phi;bug-only-if-odd-number-insts;signature-file=%t.edge>'
+; RUN: not --crash %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-aggregate-phi;bug-only-if-odd-number-insts;crash-on-shufflevector;signature-file=%t.full>'
+; RUN: diff %t.edge %t.full
+; RUN: FileCheck --check-prefix=ODD --input-file=%t.edge %s
+
+; RUN: not --crash %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-aggregate-phi;crash-on-repeated-phi-predecessor;crash-on-phi-self-reference;crash-switch-odd-number-cases;signature-file=%t.edge>'
+; RUN: not --crash %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-aggregate-phi;crash-on-repeated-phi-predecessor;crash-on-phi-self-reference;crash-switch-odd-number-cases;crash-on-shufflevector;signature-file=%t.full>'
+; RUN: diff %t.edge %t.full
+; RUN: FileCheck --check-prefix=NOGATE --input-file=%t.edge %s
+
+; ALL: {{^}}8 crash-switch-odd-number-cases{{$}}
+; PHI: {{^}}7 crash-on-phi-self-reference{{$}}
+; ODD: {{^}}5 crash-on-aggregate-phi{{$}}
+; NOGATE: {{^}}5 crash-on-aggregate-phi{{$}}
+
+; No bug, but a PHI and a switch in every block.
+define i32 @even(i32 %x) {
+entry:
+  switch i32 %x, label %b [ i32 0, label %a
+                            i32 1, label %a ]
+a:
+  %y = add i32 %x, 1
+  br label %b
+b:
+  %p = phi i32 [ %x, %entry ], [ %y, %a ]
+  ret i32 %p
+}
+
+; An even number of instructions, so the odd-number gate skips the
+; aggregate PHI.
+define { i32, i32 } @aggregate_even({ i32, i32 } %v, i1 %c) {
+entry:
+  br i1 %c, label %a, label %b
+a:
+  br label %b
+b:
+  %p = phi { i32, i32 } [ %v, %entry ], [ %v, %a ]
+  ret { i32, i32 } %p
+}
+
+; The odd switch comes in an earlier block than the self reference, which
+; comes before the aggregate PHI in its block.
+define { i32, i32 } @mixed({ i32, i32 } %v, i32 %x) {
+entry:
+  %y = add i32 %x, 1
+  switch i32 %y, label %loop [ i32 0, label %loop ]
+loop:
+  %self = phi i32 [ %x, %entry ], [ %x, %entry ], [ %self, %loop ]
+  %agg = phi { i32, i32 } [ %v, %entry ], [ %v, %entry ], [ %v, %loop ]
+  %c = icmp eq i32 %self, 0
+  br i1 %c, label %loop, label %exit
+exit:
+  ret { i32, i32 } %agg
+}
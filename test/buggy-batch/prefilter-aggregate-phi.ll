@@ -0,0 +1,21 @@
+; The prefilter must not skip an input with a PHI of a struct, so buggy-batch
+; gives the same status with and without it.
+
+; RUN: llvm-as %s -o %t.bc
+; RUN: echo "%t.bc buggy<crash-on-aggregate-phi;exit-code>" > %t.manifest
+; RUN: %buggy_batch %t.manifest | FileCheck %s
+; RUN: %buggy_batch -prefilter %t.manifest | FileCheck %s
+
+; CHECK: {{^}}105 
+
+define { i32, i32 } @f(i1 %c, { i32, i32 } %a, { i32, i32 } %b) {
+entry:
+  br i1 %c, label %then, label %join
+
+then:
+  br label %join
+
+join:
+  %p = phi { i32, i32 } [ %a, %entry ], [ %b, %then ]
+  ret { i32, i32 } %p
+}
@@ -0,0 +1,15 @@
+; crash-load-of-inttoptr only looks for inttoptr instructions, so a load from
+; an inttoptr constant expression passes, whether or not the prefilter skips
+; the input.
+
+; RUN: llvm-as %s -o %t.bc
+; RUN: echo "%t.bc buggy<crash-load-of-inttoptr;exit-code>" > %t.manifest
+; RUN: %buggy_batch %t.manifest | FileCheck %s
+; RUN: %buggy_batch -prefilter %t.manifest | FileCheck %s
+
+; CHECK: {{^}}0 
+
+define i32 @f() {
+  %v = load i32, ptr inttoptr (i64 4096 to ptr)
+  ret i32 %v
+}
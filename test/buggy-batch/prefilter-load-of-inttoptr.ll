@@ -0,0 +1,15 @@
+; The prefilter must not skip an input loading from an inttoptr instruction,
+; so buggy-batch gives the same status with and without it.
+
+; RUN: llvm-as %s -o %t.bc
+; RUN: echo "%t.bc buggy<crash-load-of-inttoptr;exit-code>" > %t.manifest
+; RUN: %buggy_batch %t.manifest | FileCheck %s
+; RUN: %buggy_batch -prefilter %t.manifest | FileCheck %s
+
+; CHECK: {{^}}103 
+
+define i32 @f(i64 %x) {
+  %p = inttoptr i64 %x to ptr
+  %v = load i32, ptr %p
+  ret i32 %v
+}
@@ -0,0 +1,23 @@
+; The input has no select, but simplifycfg turns its PHI into one before
+; buggy runs. The prefilter cannot judge such a pipeline and must run the
+; entry, so buggy-batch gives the same status with and without it.
+
+; RUN: llvm-as %s -o %t.bc
+; RUN: echo "%t.bc function(simplifycfg,buggy<crash-on-i1-select;exit-code>)" \
+; RUN:   > %t.manifest
+; RUN: %buggy_batch %t.manifest | FileCheck %s
+; RUN: %buggy_batch -prefilter %t.manifest | FileCheck %s
+
+; CHECK: {{^}}109 
+
+define i1 @f(i1 %c, i1 %a, i1 %b) {
+entry:
+  br i1 %c, label %then, label %join
+
+then:
+  br label %join
+
+join:
+  %p = phi i1 [ %a, %entry ], [ %b, %then ]
+  ret i1 %p
+}
@@ -0,0 +1,22 @@
+; The prefilter must not skip an input with a switch with an odd number of
+; cases, so buggy-batch gives the same status with and without it.
+
+; RUN: llvm-as %s -o %t.bc
+; RUN: echo "%t.bc buggy<crash-switch-odd-number-cases;exit-code>" > %t.manifest
+; RUN: %buggy_batch %t.manifest | FileCheck %s
+; RUN: %buggy_batch -prefilter %t.manifest | FileCheck %s
+
+; CHECK: {{^}}108 
+
+define i32 @f(i32 %x) {
+entry:
+  switch i32 %x, label %default [
+    i32 0, label %zero
+  ]
+
+zero:
+  ret i32 1
+
+default:
+  ret i32 0
+}
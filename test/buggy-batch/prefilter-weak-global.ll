@@ -0,0 +1,15 @@
+; The prefilter must not skip an input with a weak global, so buggy-batch
+; gives the same status with and without it.
+
+; RUN: llvm-as %s -o %t.bc
+; RUN: echo "%t.bc buggy<crash-if-weak-global-exists;exit-code>" > %t.manifest
+; RUN: %buggy_batch %t.manifest | FileCheck %s
+; RUN: %buggy_batch -prefilter %t.manifest | FileCheck %s
+
+; CHECK: {{^}}110 
+
+@g = weak global i32 0
+
+define i32 @f() {
+  ret i32 0
+}
@@ -0,0 +1,83 @@
+; buggy-parallel must hit the same first error as buggy, and make the same
+; icmp slt rewrites, on a module with several functions that trigger.
+
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-i1-select;crash-switch-odd-number-cases;exit-code;signature-file=%t.serial.sig>'; \
+; RUN:   test $? -eq 108
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy-parallel<threads=4;crash-on-i1-select;crash-switch-odd-number-cases;exit-code;signature-file=%t.parallel.sig>'; \
+; RUN:   test $? -eq 108
+; RUN: diff %t.serial.sig %t.parallel.sig
+
+; RUN: %buggy_opt -S %s -o %t.serial.ll \
+; RUN:   -passes='buggy<miscompile-icmp-slt-to-sle;miscompile-skip=1;miscompile-count=3>'
+; RUN: %buggy_opt -S %s -o %t.parallel.ll \
+; RUN:   -passes='buggy-parallel<threads=4;miscompile-icmp-slt-to-sle;miscompile-skip=1;miscompile-count=3>'
+; RUN: diff %t.serial.ll %t.parallel.ll
+; RUN: FileCheck %s < %t.parallel.ll
+
+; Sites are counted in module order, so the first is skipped and the next
+; three rewritten.
+; CHECK-LABEL: define i1 @less0(
+; CHECK: icmp slt
+; CHECK-LABEL: define i32 @odd_switch0(
+; CHECK-LABEL: define i1 @less1(
+; CHECK: icmp sle
+; CHECK: icmp sle
+; CHECK-LABEL: define i1 @select(
+; CHECK-LABEL: define i32 @odd_switch1(
+; CHECK-LABEL: define i1 @less2(
+; CHECK: icmp sle
+; CHECK: icmp slt
+
+define i1 @less0(i32 %a, i32 %b) {
+  %c = icmp slt i32 %a, %b
+  ret i1 %c
+}
+
+define i32 @odd_switch0(i32 %x) {
+entry:
+  switch i32 %x, label %default [
+    i32 0, label %zero
+  ]
+
+zero:
+  ret i32 1
+
+default:
+  ret i32 0
+}
+
+define i1 @less1(i32 %a, i32 %b, i32 %c) {
+  %x = icmp slt i32 %a, %b
+  %y = icmp slt i32 %b, %c
+  %r = and i1 %x, %y
+  ret i1 %r
+}
+
+define i1 @select(i1 %c, i1 %a, i1 %b) {
+  %s = select i1 %c, i1 %a, i1 %b
+  ret i1 %s
+}
+
+define i32 @odd_switch1(i32 %x) {
+entry:
+  switch i32 %x, label %default [
+    i32 0, label %zero
+    i32 1, label %zero
+    i32 2, label %zero
+  ]
+
+zero:
+  ret i32 1
+
+default:
+  ret i32 0
+}
+
+define i1 @less2(i32 %a, i32 %b, i32 %c) {
+  %x = icmp slt i32 %a, %b
+  %y = icmp slt i32 %b, %c
+  %r = or i1 %x, %y
+  ret i1 %r
+}
@@ -0,0 +1,90 @@
+; With exit-code, each fatal error exits with 100 plus its BuggyBugKind.
+
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-vector;exit-code>'; test $? -eq 101
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-shufflevector;exit-code>'; test $? -eq 102
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-load-of-inttoptr;exit-code>'; test $? -eq 103
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-store-to-constantexpr;exit-code>'; test $? -eq 104
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-aggregate-phi;exit-code>'; test $? -eq 105
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-repeated-phi-predecessor;exit-code>'; \
+; RUN:   test $? -eq 106
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-phi-self-reference;exit-code>'; test $? -eq 107
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-switch-odd-number-cases;exit-code>'; \
+; RUN:   test $? -eq 108
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-i1-select;exit-code>'; test $? -eq 109
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-if-weak-global-exists;exit-code>'; test $? -eq 110
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy-attr,function(buggy<crash-on-buggy-attr;exit-code>)'; \
+; RUN:   test $? -eq 111
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy-attr,function(buggy<crash-on-buggy-global-state;exit-code>)'; \
+; RUN:   test $? -eq 112
+
+@weak = weak global i32 0
+@array = global [2 x i32] zeroinitializer
+
+define <2 x i32> @shuffle(<2 x i32> %v) {
+  %s = shufflevector <2 x i32> %v, <2 x i32> poison, <2 x i32> <i32 1, i32 0>
+  ret <2 x i32> %s
+}
+
+define i32 @load_of_inttoptr(i64 %x) {
+  %p = inttoptr i64 %x to ptr
+  %v = load i32, ptr %p
+  ret i32 %v
+}
+
+define void @store_to_constantexpr() {
+  store i32 0, ptr getelementptr (i8, ptr @array, i64 4)
+  ret void
+}
+
+define { i32, i32 } @aggregate_phi(i1 %c, { i32, i32 } %a) {
+entry:
+  br i1 %c, label %then, label %join
+
+then:
+  br label %join
+
+join:
+  %p = phi { i32, i32 } [ %a, %entry ], [ zeroinitializer, %then ]
+  ret { i32, i32 } %p
+}
+
+define i32 @repeated_predecessor(i32 %x) {
+entry:
+  switch i32 %x, label %join [
+    i32 0, label %join
+  ]
+
+join:
+  %p = phi i32 [ 1, %entry ], [ 1, %entry ]
+  ret i32 %p
+}
+
+define i32 @self_reference(i32 %n) {
+entry:
+  br label %loop
+
+loop:
+  %p = phi i32 [ 0, %entry ], [ %p, %loop ]
+  %done = icmp eq i32 %n, 0
+  br i1 %done, label %exit, label %loop
+
+exit:
+  ret i32 %p
+}
+
+define i1 @i1_select(i1 %c, i1 %a, i1 %b) {
+  %s = select i1 %c, i1 %a, i1 %b
+  ret i1 %s
+}
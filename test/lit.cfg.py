@@ -0,0 +1,27 @@
+# -*- Python -*-
+
+# Tests of the buggy plugin and its tools. Run through ctest, or with lit on
+# test/ in the build directory, which holds the generated lit.site.cfg.py.
+
+import os
+
+import lit.formats
+
+config.name = 'BuggyPass'
+config.test_format = lit.formats.ShTest(not lit_config.isWindows)
+config.suffixes = ['.ll']
+config.excludes = ['Inputs']
+
+config.test_source_root = os.path.dirname(__file__)
+config.test_exec_root = config.buggy_obj_root
+
+# FileCheck, not and llvm-as come from the LLVM the plugin is built against.
+config.environment['PATH'] = os.pathsep.join(
+    [config.llvm_tools_dir, config.environment.get('PATH', '')])
+
+config.substitutions.append(
+    ('%buggy_opt',
+     '%s --load-pass-plugin=%s' % (config.opt, config.buggy_plugin)))
+config.substitutions.append(
+    ('%buggy_batch',
+     '%s --load-pass-plugin=%s' % (config.buggy_batch, config.buggy_plugin)))
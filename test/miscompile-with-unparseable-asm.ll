@@ -0,0 +1,17 @@
+; RUN: %buggy_opt -S %s \
+; RUN:   -passes='buggy<miscompile-icmp-slt-to-sle;insert-unparseable-asm>' \
+; RUN:   | FileCheck %s
+
+; insert-unparseable-asm pre-empts the per-instruction checks, so together
+; with miscompile-icmp-slt-to-sle the asm is inserted and no icmp slt is
+; queued for rewriting.
+
+; CHECK-LABEL: define i1 @less(
+; CHECK: call void asm "skynet", ""()
+; CHECK-NEXT: %cmp = icmp slt i32 %a, %b
+; CHECK-NOT: icmp sle
+define i1 @less(i32 %a, i32 %b) {
+entry:
+  %cmp = icmp slt i32 %a, %b
+  ret i1 %cmp
+}
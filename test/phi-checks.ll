@@ -0,0 +1,76 @@
+; The PHI checks look at each PHI once. Across PHIs the first one in the
+; block decides, within one PHI a repeated predecessor is reported before a
+; self reference, and predecessors shared by different PHIs are not repeats.
+
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-repeated-phi-predecessor;crash-on-phi-self-reference;report=%t.json>'
+; RUN: FileCheck --check-prefix=BOTH --input-file=%t.json %s
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-repeated-phi-predecessor;report=%t.json>'
+; RUN: FileCheck --check-prefix=REPEATED --input-file=%t.json %s
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-phi-self-reference;report=%t.json>'
+; RUN: FileCheck --check-prefix=SELF --input-file=%t.json %s
+
+; RUN: not --crash %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-repeated-phi-predecessor;crash-on-phi-self-reference;signature-file=%t.sig>'
+; RUN: FileCheck --check-prefix=SIG --input-file=%t.sig %s
+
+; BOTH: "function":"shared_preds",{{[^}]*}}"bug":"none"
+; BOTH: "function":"self_then_repeated",{{[^}]*}}"bug":"crash-on-phi-self-reference"
+; BOTH: "function":"repeated_and_self",{{[^}]*}}"bug":"crash-on-repeated-phi-predecessor"
+
+; REPEATED: "function":"shared_preds",{{[^}]*}}"bug":"none"
+; REPEATED: "function":"self_then_repeated",{{[^}]*}}"bug":"crash-on-repeated-phi-predecessor"
+; REPEATED: "function":"repeated_and_self",{{[^}]*}}"bug":"crash-on-repeated-phi-predecessor"
+
+; SELF: "function":"shared_preds",{{[^}]*}}"bug":"none"
+; SELF: "function":"self_then_repeated",{{[^}]*}}"bug":"crash-on-phi-self-reference"
+; SELF: "function":"repeated_and_self",{{[^}]*}}"bug":"crash-on-phi-self-reference"
+
+; SIG: {{^}}7 crash-on-phi-self-reference{{$}}
+
+define i32 @shared_preds(i1 %c, i32 %x, i32 %y) {
+entry:
+  br i1 %c, label %a, label %b
+a:
+  br label %join
+b:
+  br label %join
+join:
+  %p = phi i32 [ %x, %a ], [ %y, %b ]
+  %q = phi i32 [ %y, %a ], [ %x, %b ]
+  %r = phi i32 [ 0, %a ], [ 1, %b ]
+  %s = add i32 %p, %q
+  %t = add i32 %s, %r
+  ret i32 %t
+}
+
+define i32 @self_then_repeated(i1 %c, i32 %x) {
+entry:
+  br label %loop
+loop:
+  %self = phi i32 [ %x, %entry ], [ %self, %loop ]
+  br i1 %c, label %loop, label %split
+split:
+  switch i32 %x, label %exit [ i32 0, label %join
+                               i32 1, label %join ]
+join:
+  %rep = phi i32 [ 0, %split ], [ 0, %split ]
+  br label %exit
+exit:
+  %r = phi i32 [ %self, %split ], [ %rep, %join ]
+  ret i32 %r
+}
+
+define i32 @repeated_and_self(i32 %x) {
+entry:
+  br label %loop
+loop:
+  %rep = phi i32 [ %x, %entry ], [ 0, %loop ], [ 0, %loop ]
+  %both = phi i32 [ %x, %entry ], [ %both, %loop ], [ %both, %loop ]
+  switch i32 %rep, label %exit [ i32 0, label %loop
+                                 i32 1, label %loop ]
+exit:
+  ret i32 %both
+}
@@ -0,0 +1,30 @@
+; The printed parameters of buggy parse back into the same options, also when
+; a flag implied by verdict-cache-dir or report is turned off again.
+
+; RUN: %buggy_opt -disable-output -disable-verify -print-pipeline-passes %s \
+; RUN:   -passes='buggy<crash-on-vector;miscompile-skip=2;verdict-cache-dir=%t.cache;no-verdict-cache;report=%t.json;no-dry-run;buggy-phase=none>' \
+; RUN:   > %t.printed
+; RUN: FileCheck %s < %t.printed
+; RUN: %buggy_opt -disable-output -disable-verify -print-pipeline-passes %s \
+; RUN:   -passes="$(cat %t.printed)" | diff %t.printed -
+
+; RUN: %buggy_opt -disable-output -disable-verify -print-pipeline-passes %s \
+; RUN:   -passes='buggy-parallel<threads=2;verdict-cache-dir=%t.cache;report=%t.json>' \
+; RUN:   > %t.parallel
+; RUN: FileCheck --check-prefix=PARALLEL %s < %t.parallel
+; RUN: %buggy_opt -disable-output -disable-verify -print-pipeline-passes %s \
+; RUN:   -passes="$(cat %t.parallel)" | diff %t.parallel -
+
+; CHECK: buggy<crash-on-vector;miscompile-skip=2;verdict-cache-dir={{.*}}.cache;no-verdict-cache;report={{.*}}.json;no-dry-run;buggy-phase=none;>
+; PARALLEL: buggy-parallel<threads=2;dry-run;verdict-cache;verdict-cache-dir={{.*}}.cache;report={{.*}}.json;>
+
+; Paths that could not be printed back are rejected.
+; RUN: not %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<signature-file=a>b>' 2>&1 \
+; RUN:   | FileCheck --check-prefix=ERR %s
+; RUN: not %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<report=a<b>' 2>&1 \
+; RUN:   | FileCheck --check-prefix=ERR-REPORT %s
+
+; ERR: invalid buggy signature-file path 'a>b', which cannot contain any of ',()<>'
+; ERR-REPORT: invalid buggy report path 'a<b', which cannot contain any of ',()<>'
@@ -0,0 +1,34 @@
+; report counts the constructs of every function checked in the same walk
+; as the checks, past the first error, and also for functions a gate decided
+; before any walk.
+
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-i1-select;bug-only-if-external-func;report=%t.json>'
+; RUN: FileCheck --input-file=%t.json %s
+
+; CHECK: "function":"counted",
+; CHECK-SAME: "instructions":6,
+; CHECK-SAME: "bug":"crash-on-i1-select",
+; CHECK-SAME: "visited":{"crash-on-i1-select":1},
+; CHECK-SAME: "shufflevectors":1,"vector_values":1,"inttoptr_loads":1,
+; CHECK-SAME: "constantexpr_stores":0,"odd_switches":0,"i1_selects":2,
+; CHECK-SAME: "indirect_calls":0
+; CHECK-SAME: "function":"gated",
+; CHECK-SAME: "instructions":2,
+; CHECK-SAME: "bug":"none",
+; CHECK-SAME: "visited":{},
+; CHECK-SAME: "i1_selects":1,
+
+define <2 x i32> @counted(i1 %c, i1 %a, i64 %p, <2 x i32> %v) {
+  %s = select i1 %c, i1 %a, i1 false
+  %t = select i1 %s, i1 %a, i1 %c
+  %ptr = inttoptr i64 %p to ptr
+  %x = load i32, ptr %ptr
+  %w = shufflevector <2 x i32> %v, <2 x i32> %v, <2 x i32> <i32 1, i32 0>
+  ret <2 x i32> %w
+}
+
+define internal i1 @gated(i1 %c, i1 %a) {
+  %s = select i1 %c, i1 %a, i1 false
+  ret i1 %s
+}
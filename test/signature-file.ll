@@ -0,0 +1,23 @@
+; signature-file holds the ID and name of the error that was hit, and a
+; signature left behind by an earlier run is removed even if there is none.
+
+; RUN: echo "1 crash-on-vector" > %t.sig
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-shufflevector;signature-file=%t.sig>'
+; RUN: test ! -e %t.sig
+
+; RUN: not --crash %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-i1-select;signature-file=%t.sig>'
+; RUN: FileCheck --input-file=%t.sig %s
+
+; RUN: echo "1 crash-on-vector" > %t.sig
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy-parallel<crash-on-shufflevector;signature-file=%t.sig>'
+; RUN: test ! -e %t.sig
+
+; CHECK: {{^}}9 crash-on-i1-select{{$}}
+
+define i1 @f(i1 %c, i1 %a, i1 %b) {
+  %s = select i1 %c, i1 %a, i1 %b
+  ret i1 %s
+}
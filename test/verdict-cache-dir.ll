@@ -0,0 +1,44 @@
+; verdict-cache-dir keeps the verdicts of each process in one verdicts-<pid>
+; file, and a later process reads them all back instead of checking again.
+; The first run has dry-run, which report implies, so the options match.
+
+; RUN: rm -rf %t.dir && mkdir %t.dir
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-phi-self-reference;verdict-cache-dir=%t.dir;dry-run>'
+; RUN: ls %t.dir | FileCheck --check-prefix=FILES %s
+; RUN: cat %t.dir/verdicts-* | FileCheck --check-prefix=LINES %s
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-phi-self-reference;verdict-cache-dir=%t.dir;report=%t.json>'
+; RUN: FileCheck --check-prefix=CACHED --input-file=%t.json %s
+; RUN: ls %t.dir | FileCheck --check-prefix=FILES %s
+
+; A partial line, as left by a process that crashed mid-write, is skipped.
+; RUN: printf '0123' >> %t.dir/verdicts-0
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-phi-self-reference;verdict-cache-dir=%t.dir;report=%t.json>'
+; RUN: FileCheck --check-prefix=CACHED --input-file=%t.json %s
+
+; FILES: {{^}}verdicts-{{[0-9]+$}}
+; FILES-NOT: verdicts-
+
+; LINES: {{^[0-9a-f]{16} 1$}}
+; LINES-NEXT: {{^[0-9a-f]{16} 1$}}
+; LINES-NOT: {{.}}
+
+; CACHED: "function":"f",{{[^}]*}}"cached":true
+; CACHED: "function":"g",{{[^}]*}}"cached":true
+
+define i32 @f(i32 %x) {
+  %y = add i32 %x, 1
+  ret i32 %y
+}
+
+define i32 @g(i32 %x, i1 %c) {
+entry:
+  br i1 %c, label %a, label %b
+a:
+  br label %b
+b:
+  %p = phi i32 [ %x, %entry ], [ 0, %a ]
+  ret i32 %p
+}
@@ -0,0 +1,37 @@
+; Functions that differ only in what a check reads must not share a cached
+; verdict. @ok, checked first and cached as harmless, and @bad differ only
+; in a PHI operand and a store's pointer, which StructuralHash does not tell
+; apart beyond their type.
+
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-on-phi-self-reference;verdict-cache;exit-code>'; \
+; RUN:   test $? -eq 107
+; RUN: %buggy_opt -disable-output %s \
+; RUN:   -passes='buggy<crash-store-to-constantexpr;verdict-cache;exit-code>'; \
+; RUN:   test $? -eq 104
+
+@g = global [2 x i32] zeroinitializer
+
+define i32 @ok(i32 %x, i1 %c, ptr %p) {
+entry:
+  br label %loop
+loop:
+  %phi = phi i32 [ %x, %entry ], [ %next, %loop ]
+  %next = add i32 %phi, 1
+  store i32 %next, ptr @g
+  br i1 %c, label %loop, label %exit
+exit:
+  ret i32 %next
+}
+
+define i32 @bad(i32 %x, i1 %c, ptr %p) {
+entry:
+  br label %loop
+loop:
+  %phi = phi i32 [ %x, %entry ], [ %phi, %loop ]
+  %next = add i32 %phi, 1
+  store i32 %next, ptr getelementptr ([2 x i32], ptr @g, i64 0, i64 1)
+  br i1 %c, label %loop, label %exit
+exit:
+  ret i32 %next
+}
@@ -0,0 +1,358 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Runs many (input, pipeline) pairs in one process. Pass plugins are loaded
+// once, and every entry of the manifest is parsed into a fresh LLVMContext and
+// run inside a CrashRecoveryContext, so a crashing or exiting pipeline is
+// reported as that entry's verdict instead of ending the batch.
+//
+// The manifest has one entry per line: an input file, whitespace, and the
+// pass pipeline to run on it. Blank lines and lines starting with # are
+// ignored.
+//
+// With -lazy, bitcode inputs are loaded lazily and the pipeline, which must
+// then be a function pipeline, runs on one function at a time. Each function
+// is materialized, run and has its body deleted again before the next, so
+// memory use is bounded by the largest function rather than the module.
+//
+// With -prefilter, bitcode inputs that cannot hit any bug enabled on the buggy
+// pass starting their pipeline are reported as passing after a scan of their
+// records, without being parsed or run. Entries whose pipeline runs anything
+// before buggy, which could create what a bug needs, are always run.
+//
+//===----------------------------------------------------------------------===//
+
+#include "common/BuggyBitcodeFilter.h"
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/CrashRecoveryContext.h"
+#include "llvm/Support/ErrorHandling.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FormatVariadic.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/LineIterator.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/Process.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+using namespace llvm;
+
+static cl::opt<std::string> ManifestFilename(cl::Positional,
+                                             cl::desc("<manifest>"),
+                                             cl::Required);
+
+static cl::list<std::string>
+    PassPlugins("load-pass-plugin",
+                cl::desc("Load passes from plugin library"));
+
+static cl::opt<std::string> OutputFilename("o", cl::desc("Output filename"),
+                                           cl::value_desc("filename"),
+                                           cl::init("-"));
+
+static cl::opt<unsigned>
+    Threads("j",
+            cl::desc("Number of entries to run at once (0 for one per core)"),
+            cl::init(1));
+
+static cl::opt<bool>
+    Lazy("lazy", cl::desc("Run function pipelines on one function at a time, "
+                          "materializing bitcode lazily"));
+
+static cl::opt<bool>
+    DisableVerify("disable-verify",
+                  cl::desc("Do not verify inputs before and after the "
+                           "pipeline"));
+
+static cl::opt<bool>
+    Prefilter("prefilter",
+              cl::desc("Report bitcode inputs that cannot fail the buggy "
+                       "pass starting their pipeline as passing without "
+                       "running them"));
+
+static const char *ToolName;
+
+namespace {
+struct ManifestEntry {
+  std::string Input;
+  std::string Pipeline;
+};
+
+struct Verdict {
+  /// The exit status opt would have had. A crash reports 128 plus the signal
+  /// number, as a shell would.
+  int Status = 0;
+  double Seconds = 0;
+};
+} // anonymous namespace
+
+static Expected<std::vector<ManifestEntry>> readManifest(StringRef Filename) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      MemoryBuffer::getFileOrSTDIN(Filename, /*IsText=*/true);
+  if (!Buffer)
+    return errorCodeToError(Buffer.getError());
+
+  std::vector<ManifestEntry> Entries;
+  for (line_iterator I(**Buffer, /*SkipBlanks=*/true, '#'); !I.is_at_eof();
+       ++I) {
+    StringRef Line = I->trim();
+    size_t Split = Line.find_first_of(" \t");
+    StringRef Input = Line.take_front(Split);
+    StringRef Pipeline = Line.substr(Split).trim();
+    if (Pipeline.empty()) {
+      return createStringError(inconvertibleErrorCode(),
+                               "%s:%lld: expected an input and a pipeline",
+                               Filename.str().c_str(),
+                               (long long)I.line_number());
+    }
+    Entries.push_back({Input.str(), Pipeline.str()});
+  }
+  return Entries;
+}
+
+namespace {
+/// A PassBuilder with the plugins loaded and the analysis managers set up.
+struct EntryPassBuilder {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB;
+
+  explicit EntryPassBuilder(ArrayRef<PassPlugin> Plugins) {
+    for (const PassPlugin &Plugin : Plugins)
+      Plugin.registerPassBuilderCallbacks(PB);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  }
+};
+} // anonymous namespace
+
+/// Run the function pipeline of \p Entry over a lazily loaded module, one
+/// function at a time.
+static int runEntryLazily(const ManifestEntry &Entry,
+                          std::unique_ptr<MemoryBuffer> Buffer,
+                          ArrayRef<PassPlugin> Plugins) {
+  LLVMContext Ctx;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = getLazyIRModule(std::move(Buffer), Err, Ctx);
+  if (!M) {
+    Err.print(ToolName, errs());
+    return 1;
+  }
+
+  EntryPassBuilder EPB(Plugins);
+  FunctionPassManager FPM;
+  if (Error E = EPB.PB.parsePassPipeline(FPM, Entry.Pipeline)) {
+    errs() << ToolName << ": " << toString(std::move(E)) << '\n';
+    return 1;
+  }
+
+  // The buggy pass only uses the module facts once computed, to keep module
+  // walks out of its per-function run, and nothing else computes them here.
+  // They only look at globals and module flags, which are all loaded
+  // already.
+  ModulePassManager FactsPM;
+  if (Error E =
+          EPB.PB.parsePassPipeline(FactsPM, "require<buggy-module-facts>"))
+    consumeError(std::move(E));
+  else
+    FactsPM.run(*M, EPB.MAM);
+
+  for (Function &F : *M) {
+    if (Error E = F.materialize()) {
+      errs() << ToolName << ": " << Entry.Input << ": "
+             << toString(std::move(E)) << '\n';
+      return 1;
+    }
+    if (F.isDeclaration())
+      continue;
+
+    if (!DisableVerify && verifyFunction(F, &errs())) {
+      errs() << ToolName << ": " << Entry.Input << ": error: function '"
+             << F.getName() << "' is broken!\n";
+      return 1;
+    }
+
+    FPM.run(F, EPB.FAM);
+
+    // Drop the body again, and the analyses referring to it, before moving
+    // on. The function stays behind as a declaration, but with its own
+    // linkage rather than the external one deleteBody gives it, so the
+    // checks of later functions still see a weak or internal function as
+    // such.
+    EPB.FAM.clear(F, F.getName());
+    GlobalValue::LinkageTypes Linkage = F.getLinkage();
+    F.deleteBody();
+    F.setLinkage(Linkage);
+  }
+  return 0;
+}
+
+/// Parse and run one entry, returning the exit code opt would have used.
+/// Runs inside a CrashRecoveryContext.
+static int runEntry(const ManifestEntry &Entry,
+                    ArrayRef<PassPlugin> Plugins) {
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      MemoryBuffer::getFileOrSTDIN(Entry.Input, /*IsText=*/true);
+  if (!Buffer) {
+    errs() << ToolName << ": " << Entry.Input << ": "
+           << Buffer.getError().message() << '\n';
+    return 1;
+  }
+
+  if (Prefilter) {
+    Expected<buggy_prefilter::BitcodeFilter> Filter =
+        buggy_prefilter::BitcodeFilter::createForPipeline(Entry.Pipeline);
+    if (!Filter)
+      consumeError(Filter.takeError());
+    else if (!Filter->mayFail(**Buffer))
+      return 0;
+  }
+
+  if (Lazy)
+    return runEntryLazily(Entry, std::move(*Buffer), Plugins);
+
+  LLVMContext Ctx;
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseIR(**Buffer, Err, Ctx);
+  if (!M) {
+    Err.print(ToolName, errs());
+    return 1;
+  }
+
+  if (!DisableVerify && verifyModule(*M, &errs())) {
+    errs() << ToolName << ": " << Entry.Input
+           << ": error: input module is broken!\n";
+    return 1;
+  }
+
+  EntryPassBuilder EPB(Plugins);
+  ModulePassManager MPM;
+  if (Error E = EPB.PB.parsePassPipeline(MPM, Entry.Pipeline)) {
+    errs() << ToolName << ": " << toString(std::move(E)) << '\n';
+    return 1;
+  }
+  if (!DisableVerify)
+    MPM.addPass(VerifierPass());
+
+  MPM.run(*M, EPB.MAM);
+  return 0;
+}
+
+static Verdict evaluate(const ManifestEntry &Entry,
+                        ArrayRef<PassPlugin> Plugins) {
+  Verdict V;
+  auto Start = std::chrono::steady_clock::now();
+
+  CrashRecoveryContext CRC;
+  if (!CRC.RunSafely([&] { V.Status = runEntry(Entry, Plugins); }))
+    V.Status = CRC.RetCode;
+
+  V.Seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                            Start)
+                  .count();
+  return V;
+}
+
+static void printVerdicts(raw_ostream &OS, ArrayRef<ManifestEntry> Entries,
+                          ArrayRef<Verdict> Verdicts) {
+  size_t InputWidth = strlen("input");
+  for (const ManifestEntry &Entry : Entries)
+    InputWidth = std::max(InputWidth, Entry.Input.size());
+
+  OS << formatv("{0,-7} {1,10} {2} {3}\n", "status", "seconds",
+                left_justify("input", InputWidth), "pipeline");
+  for (auto [Entry, V] : zip(Entries, Verdicts)) {
+    OS << formatv("{0,-7} {1,10:f4} {2} {3}\n", V.Status, V.Seconds,
+                  left_justify(Entry.Input, InputWidth), Entry.Pipeline);
+  }
+}
+
+/// Print a fatal error the way report_fatal_error does. The ones without a
+/// crash diagnostic would then call exit and end the whole batch, so end
+/// only the current entry, with the same status of 1, instead. The others go
+/// on to abort, which the CrashRecoveryContext already recovers from.
+static void handleFatalError(void *, const char *Reason, bool GenCrashDiag) {
+  errs() << "LLVM ERROR: " << Reason << '\n';
+  if (!GenCrashDiag)
+    sys::Process::Exit(1);
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  ToolName = argv[0];
+
+  cl::ParseCommandLineOptions(argc, argv, "buggy plugin batch driver\n");
+
+  // Recover from crashes and from pipelines calling sys::Process::Exit. Plain
+  // exit cannot be intercepted, so also route the fatal errors that would end
+  // with it through sys::Process::Exit.
+  CrashRecoveryContext::Enable();
+  install_fatal_error_handler(handleFatalError);
+
+  Expected<std::vector<ManifestEntry>> Entries =
+      readManifest(ManifestFilename);
+  if (!Entries) {
+    errs() << ToolName << ": " << toString(Entries.takeError()) << '\n';
+    return 1;
+  }
+
+  std::vector<PassPlugin> Plugins;
+  for (const std::string &PluginPath : PassPlugins) {
+    Expected<PassPlugin> Plugin = PassPlugin::Load(PluginPath);
+    if (!Plugin) {
+      errs() << ToolName << ": " << toString(Plugin.takeError()) << '\n';
+      return 1;
+    }
+    Plugins.push_back(std::move(*Plugin));
+  }
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::OF_TextWithCRLF);
+  if (EC) {
+    errs() << ToolName << ": " << OutputFilename << ": " << EC.message()
+           << '\n';
+    return 1;
+  }
+
+  std::vector<Verdict> Verdicts(Entries->size());
+  if (Threads == 1) {
+    for (size_t I = 0, E = Entries->size(); I != E; ++I)
+      Verdicts[I] = evaluate((*Entries)[I], Plugins);
+  } else {
+    DefaultThreadPool Pool(hardware_concurrency(Threads));
+    for (size_t I = 0, E = Entries->size(); I != E; ++I) {
+      Pool.async(
+          [&, I] { Verdicts[I] = evaluate((*Entries)[I], Plugins); });
+    }
+    Pool.wait();
+  }
+
+  printVerdicts(Out.os(), *Entries, Verdicts);
+  Out.keep();
+  return 0;
+}
@@ -0,0 +1,333 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Measures the overhead of the buggy plugin. Synthesizes modules over a grid of
+// shapes, then times buggy with each option on its own, and buggy-attr in
+// both tagging modes, and writes the results as JSON. Options are combined
+// with dry-run, so the checks run in full but nothing crashes, hangs or
+// modifies the module.
+//
+//===----------------------------------------------------------------------===//
+
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/JSON.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+
+#include <chrono>
+#include <optional>
+
+using namespace llvm;
+
+static cl::opt<std::string>
+    PluginPath("load-pass-plugin", cl::desc("Path to the buggy plugin"),
+               cl::value_desc("path"), cl::Required);
+
+static cl::opt<std::string> OutputFilename("o",
+                                           cl::desc("Output JSON filename"),
+                                           cl::value_desc("filename"),
+                                           cl::init("-"));
+
+static cl::list<unsigned>
+    NumFunctions("functions", cl::desc("Function counts to measure"),
+                 cl::CommaSeparated);
+
+static cl::list<unsigned>
+    NumBlocks("blocks", cl::desc("Blocks per function to measure"),
+              cl::CommaSeparated);
+
+static cl::list<unsigned>
+    PhiFanIn("phi-fan-in",
+             cl::desc("Predecessors of each join block to measure"),
+             cl::CommaSeparated);
+
+static cl::list<unsigned>
+    SwitchCases("switch-cases",
+                cl::desc("Cases per switch terminator to measure"),
+                cl::CommaSeparated);
+
+static cl::list<unsigned>
+    VectorPercent("vector-percent",
+                  cl::desc("Percentage of arithmetic done on vectors"),
+                  cl::CommaSeparated);
+
+static cl::opt<unsigned>
+    InstsPerBlock("insts-per-block",
+                  cl::desc("Arithmetic instructions in each arm block"),
+                  cl::init(8));
+
+static cl::opt<unsigned> Repetitions("repetitions",
+                                     cl::desc("Timed runs per measurement"),
+                                     cl::init(5));
+
+static cl::list<std::string>
+    Options("option",
+            cl::desc("Only measure these buggy options (default: all)"),
+            cl::CommaSeparated);
+
+/// Every option of the buggy pass that enables a bug or a gate. Each is
+/// measured on its own.
+static const char *const AllOptions[] = {
+#define BUGGY_OPTION(Field, Name) Name,
+#define BUGGY_MODE_OPTION(Field, Name)
+#include "BuggyOptions.def"
+};
+
+namespace {
+struct ModuleShape {
+  unsigned Functions;
+  unsigned Blocks;
+  unsigned FanIn;
+  unsigned Cases;
+  unsigned VectorPercent;
+};
+
+struct Timing {
+  uint64_t MinNs;
+  uint64_t MedianNs;
+};
+} // anonymous namespace
+
+/// Emit the arithmetic of one arm block, with roughly \p VectorPercent percent
+/// of it done on <4 x i32> through insertelement, shufflevector and
+/// extractelement.
+static Value *emitArm(IRBuilder<> &B, Value *Acc, Value *Ptr, unsigned Seed,
+                      unsigned VectorPercent) {
+  Type *I32 = B.getInt32Ty();
+  auto *VecTy = FixedVectorType::get(I32, 4);
+  for (unsigned I = 0; I != InstsPerBlock; ++I) {
+    if ((Seed * 37 + I * 61) % 100 < VectorPercent) {
+      Value *Vec = B.CreateInsertElement(PoisonValue::get(VecTy), Acc,
+                                         uint64_t(0));
+      Vec = B.CreateShuffleVector(Vec, ArrayRef<int>{0, 0, 0, 0});
+      Vec = B.CreateAdd(Vec, ConstantInt::get(VecTy, Seed + I));
+      Acc = B.CreateExtractElement(Vec, uint64_t(I % 4));
+    } else if (I % 3 == 0) {
+      B.CreateStore(Acc, Ptr);
+      Acc = B.CreateAdd(Acc, B.CreateLoad(I32, Ptr));
+    } else {
+      Acc = B.CreateMul(Acc, ConstantInt::get(I32, Seed + I + 1));
+    }
+  }
+  return Acc;
+}
+
+/// Build a function out of diamond groups: a header switching on the running
+/// value into FanIn arms, which all branch to a join block merging their
+/// results with a PHI.
+static void emitFunction(Module &M, const ModuleShape &Shape, unsigned Idx) {
+  LLVMContext &Ctx = M.getContext();
+  Type *I32 = Type::getInt32Ty(Ctx);
+  FunctionType *FTy =
+      FunctionType::get(I32, {I32, PointerType::getUnqual(Ctx)}, false);
+  Function *F =
+      Function::Create(FTy, Idx % 2 ? GlobalValue::InternalLinkage
+                                    : GlobalValue::ExternalLinkage,
+                       "f" + Twine(Idx), M);
+  Value *Arg = F->getArg(0);
+  Value *Ptr = F->getArg(1);
+
+  IRBuilder<> B(BasicBlock::Create(Ctx, "entry", F));
+  Value *Acc = Arg;
+
+  const unsigned FanIn = std::max(Shape.FanIn, 1u);
+  const unsigned Groups = std::max(Shape.Blocks / (FanIn + 2), 1u);
+  for (unsigned G = 0; G != Groups; ++G) {
+    BasicBlock *Join = BasicBlock::Create(Ctx, "join", F);
+    SmallVector<BasicBlock *, 8> Arms;
+    for (unsigned A = 0; A != FanIn; ++A)
+      Arms.push_back(BasicBlock::Create(Ctx, "arm", F, Join));
+
+    Value *Cmp = B.CreateICmpSLT(Acc, Arg);
+    Value *Cond = B.CreateSelect(Cmp, Acc, Arg);
+    SwitchInst *Switch = B.CreateSwitch(Cond, Arms.back(), Shape.Cases);
+    for (unsigned C = 0; C != Shape.Cases; ++C)
+      Switch->addCase(B.getInt32(C), Arms[C % FanIn]);
+
+    B.SetInsertPoint(Join);
+    PHINode *Phi = B.CreatePHI(I32, FanIn);
+    for (unsigned A = 0; A != FanIn; ++A) {
+      B.SetInsertPoint(Arms[A]);
+      Value *Result = emitArm(B, Acc, Ptr, Idx + G + A, Shape.VectorPercent);
+      B.CreateBr(Join);
+      Phi->addIncoming(Result, Arms[A]);
+    }
+
+    B.SetInsertPoint(Join);
+    Acc = Phi;
+  }
+  B.CreateRet(Acc);
+}
+
+static std::unique_ptr<Module> buildModule(LLVMContext &Ctx,
+                                           const ModuleShape &Shape) {
+  auto M = std::make_unique<Module>("buggy-bench", Ctx);
+  for (unsigned I = 0; I != Shape.Functions; ++I)
+    emitFunction(*M, Shape, I);
+  return M;
+}
+
+namespace {
+/// Runs pipelines over copies of a module with the plugin loaded.
+class BenchRunner {
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassBuilder PB;
+
+public:
+  Error init(PassPlugin &Plugin) {
+    Plugin.registerPassBuilderCallbacks(PB);
+    PB.registerModuleAnalyses(MAM);
+    PB.registerCGSCCAnalyses(CGAM);
+    PB.registerFunctionAnalyses(FAM);
+    PB.registerLoopAnalyses(LAM);
+    PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+    return Error::success();
+  }
+
+  Expected<Timing> measure(const Module &M, StringRef Pipeline) {
+    ModulePassManager MPM;
+    if (Error E = PB.parsePassPipeline(MPM, Pipeline))
+      return std::move(E);
+
+    SmallVector<uint64_t, 8> Samples;
+    for (unsigned I = 0; I != std::max(Repetitions.getValue(), 1u); ++I) {
+      std::unique_ptr<Module> Copy = CloneModule(M);
+      auto Start = std::chrono::steady_clock::now();
+      MPM.run(*Copy, MAM);
+      auto End = std::chrono::steady_clock::now();
+      Samples.push_back(
+          std::chrono::duration_cast<std::chrono::nanoseconds>(End - Start)
+              .count());
+
+      // The cached results refer to the copy about to be destroyed.
+      FAM.clear();
+      MAM.clear();
+    }
+
+    llvm::sort(Samples);
+    return Timing{Samples.front(), Samples[Samples.size() / 2]};
+  }
+};
+} // anonymous namespace
+
+static void addDefault(cl::list<unsigned> &List,
+                       std::initializer_list<unsigned> Defaults) {
+  if (List.empty())
+    for (unsigned V : Defaults)
+      List.push_back(V);
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  cl::ParseCommandLineOptions(argc, argv, "buggy plugin benchmark\n");
+
+  addDefault(NumFunctions, {16, 256});
+  addDefault(NumBlocks, {8, 64});
+  addDefault(PhiFanIn, {2, 8});
+  addDefault(SwitchCases, {2, 7});
+  addDefault(VectorPercent, {0, 25});
+
+  SmallVector<std::string, 0> Measured;
+  if (Options.empty())
+    Measured.append(std::begin(AllOptions), std::end(AllOptions));
+  else
+    Measured.append(Options.begin(), Options.end());
+
+  Expected<PassPlugin> Plugin = PassPlugin::Load(PluginPath);
+  if (!Plugin) {
+    errs() << argv[0] << ": " << toString(Plugin.takeError()) << '\n';
+    return 1;
+  }
+
+  BenchRunner Runner;
+  if (Error E = Runner.init(*Plugin)) {
+    errs() << argv[0] << ": " << toString(std::move(E)) << '\n';
+    return 1;
+  }
+
+  std::error_code EC;
+  ToolOutputFile Out(OutputFilename, EC, sys::fs::OF_TextWithCRLF);
+  if (EC) {
+    errs() << argv[0] << ": " << OutputFilename << ": " << EC.message()
+           << '\n';
+    return 1;
+  }
+
+  SmallVector<ModuleShape, 0> Shapes;
+  for (unsigned Functions : NumFunctions)
+    for (unsigned Blocks : NumBlocks)
+      for (unsigned FanIn : PhiFanIn)
+        for (unsigned Cases : SwitchCases)
+          for (unsigned Vector : VectorPercent)
+            Shapes.push_back({Functions, Blocks, FanIn, Cases, Vector});
+
+  json::OStream J(Out.os(), /*IndentSize=*/2);
+  J.arrayBegin();
+  for (const ModuleShape &Shape : Shapes) {
+    LLVMContext Ctx;
+    std::unique_ptr<Module> M = buildModule(Ctx, Shape);
+    if (verifyModule(*M, &errs())) {
+      errs() << argv[0] << ": error: generated module is broken!\n";
+      return 1;
+    }
+
+    size_t NumInsts = M->getInstructionCount();
+
+    auto Report = [&](StringRef Pipeline) -> bool {
+      Expected<Timing> T = Runner.measure(*M, Pipeline);
+      if (!T) {
+        errs() << argv[0] << ": " << Pipeline << ": "
+               << toString(T.takeError()) << '\n';
+        return false;
+      }
+
+      J.object([&] {
+        J.attribute("pipeline", Pipeline);
+        J.attribute("functions", Shape.Functions);
+        J.attribute("blocks", Shape.Blocks);
+        J.attribute("phi_fan_in", Shape.FanIn);
+        J.attribute("switch_cases", Shape.Cases);
+        J.attribute("vector_percent", Shape.VectorPercent);
+        J.attribute("instructions", int64_t(NumInsts));
+        J.attribute("repetitions", Repetitions.getValue());
+        J.attribute("min_ns", int64_t(T->MinNs));
+        J.attribute("median_ns", int64_t(T->MedianNs));
+        J.attribute("median_ns_per_function",
+                    double(T->MedianNs) / std::max(Shape.Functions, 1u));
+        J.attribute("median_ns_per_instruction",
+                    double(T->MedianNs) / std::max<size_t>(NumInsts, 1));
+      });
+      return true;
+    };
+
+    for (const std::string &Option : Measured) {
+      if (!Report("buggy<" + Option + ";dry-run>"))
+        return 1;
+    }
+    if (!Report("buggy-attr") || !Report("buggy-attr<module-flag>"))
+      return 1;
+  }
+  J.arrayEnd();
+  Out.os() << '\n';
+
+  Out.keep();
+  return 0;
+}
@@ -0,0 +1,172 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Wire format shared by buggy-oracle and buggy-oracle-client. This is kept
+// free of LLVM dependencies so the client stays cheap to start.
+//
+// Each connection carries one candidate. The client sends a 32-bit length
+// followed by a name for the candidate, used in diagnostics only. Attached as
+// SCM_RIGHTS are an open descriptor for the candidate itself, followed by the
+// client's stdout and stderr so the pipeline's output goes wherever the
+// client's would. Passing the descriptor rather than a path lets the server
+// map the caller's file, memfd or shared memory object directly. The server
+// replies with the 32-bit wait status of the process that ran the pipeline,
+// or -1 if it could not run it at all.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef BUGGY_ORACLE_PROTOCOL_H
+#define BUGGY_ORACLE_PROTOCOL_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace buggy_oracle {
+
+/// File descriptors passed along with each request, in order.
+enum PassedFd { CandidateFd, StdoutFd, StderrFd, NumPassedFds };
+
+/// Upper bound on the payload of a request.
+constexpr uint32_t MaxPayloadSize = 1 << 16;
+
+/// Exit code the client uses when it cannot get an answer from the server.
+/// Interestingness scripts must treat this as not interesting.
+constexpr int OracleUnavailableExitCode = 255;
+
+inline bool writeAll(int FD, const void *Buf, size_t Size) {
+  const char *Ptr = static_cast<const char *>(Buf);
+  while (Size != 0) {
+    ssize_t Written = ::write(FD, Ptr, Size);
+    if (Written < 0) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    Ptr += Written;
+    Size -= Written;
+  }
+  return true;
+}
+
+inline bool readAll(int FD, void *Buf, size_t Size) {
+  char *Ptr = static_cast<char *>(Buf);
+  while (Size != 0) {
+    ssize_t Read = ::read(FD, Ptr, Size);
+    if (Read < 0 && errno == EINTR)
+      continue;
+    if (Read <= 0)
+      return false;
+    Ptr += Read;
+    Size -= Read;
+  }
+  return true;
+}
+
+inline bool sendRequest(int Sock, const std::string &Payload,
+                        const int (&Fds)[NumPassedFds]) {
+  if (Payload.size() > MaxPayloadSize)
+    return false;
+
+  uint32_t Size = Payload.size();
+  std::string Buf(reinterpret_cast<const char *>(&Size), sizeof(Size));
+  Buf += Payload;
+
+  union {
+    char Buf[CMSG_SPACE(sizeof(Fds))];
+    struct cmsghdr Align;
+  } Control;
+  std::memset(&Control, 0, sizeof(Control));
+
+  struct iovec IOV;
+  IOV.iov_base = &Buf[0];
+  IOV.iov_len = Buf.size();
+
+  struct msghdr Msg;
+  std::memset(&Msg, 0, sizeof(Msg));
+  Msg.msg_iov = &IOV;
+  Msg.msg_iovlen = 1;
+  Msg.msg_control = Control.Buf;
+  Msg.msg_controllen = sizeof(Control.Buf);
+
+  struct cmsghdr *CMsg = CMSG_FIRSTHDR(&Msg);
+  CMsg->cmsg_level = SOL_SOCKET;
+  CMsg->cmsg_type = SCM_RIGHTS;
+  CMsg->cmsg_len = CMSG_LEN(sizeof(Fds));
+  std::memcpy(CMSG_DATA(CMsg), Fds, sizeof(Fds));
+
+  ssize_t Sent;
+  do
+    Sent = ::sendmsg(Sock, &Msg, 0);
+  while (Sent < 0 && errno == EINTR);
+  if (Sent < 0)
+    return false;
+
+  // The descriptors travel with the first byte; the rest of a short write can
+  // go out as plain data.
+  return writeAll(Sock, Buf.data() + Sent, Buf.size() - Sent);
+}
+
+inline bool receiveRequest(int Sock, std::string &Payload,
+                           int (&Fds)[NumPassedFds]) {
+  uint32_t Size = 0;
+  union {
+    char Buf[CMSG_SPACE(sizeof(Fds))];
+    struct cmsghdr Align;
+  } Control;
+  std::memset(&Control, 0, sizeof(Control));
+
+  struct iovec IOV;
+  IOV.iov_base = &Size;
+  IOV.iov_len = sizeof(Size);
+
+  struct msghdr Msg;
+  std::memset(&Msg, 0, sizeof(Msg));
+  Msg.msg_iov = &IOV;
+  Msg.msg_iovlen = 1;
+  Msg.msg_control = Control.Buf;
+  Msg.msg_controllen = sizeof(Control.Buf);
+
+  ssize_t Received;
+  do
+    Received = ::recvmsg(Sock, &Msg, 0);
+  while (Received < 0 && errno == EINTR);
+  if (Received <= 0)
+    return false;
+
+  struct cmsghdr *CMsg = CMSG_FIRSTHDR(&Msg);
+  if (!CMsg || CMsg->cmsg_level != SOL_SOCKET ||
+      CMsg->cmsg_type != SCM_RIGHTS || CMsg->cmsg_len != CMSG_LEN(sizeof(Fds)))
+    return false;
+  std::memcpy(Fds, CMSG_DATA(CMsg), sizeof(Fds));
+
+  char *SizePtr = reinterpret_cast<char *>(&Size);
+  if (!readAll(Sock, SizePtr + Received, sizeof(Size) - Received) ||
+      Size > MaxPayloadSize) {
+    for (int FD : Fds)
+      ::close(FD);
+    return false;
+  }
+
+  Payload.resize(Size);
+  if (!readAll(Sock, &Payload[0], Size)) {
+    for (int FD : Fds)
+      ::close(FD);
+    return false;
+  }
+  return true;
+}
+
+} // namespace buggy_oracle
+
+#endif // BUGGY_ORACLE_PROTOCOL_H
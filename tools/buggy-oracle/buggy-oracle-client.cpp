@@ -0,0 +1,77 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Thin client for buggy-oracle, meant to be called from an interestingness
+// script. Exits with the status the oracle's pipeline run finished with, using
+// the shell's 128 + signal convention for crashes. Deliberately does not link
+// against LLVM.
+//
+// The candidate is handed over as an open descriptor, never copied. Passing
+// "-" forwards stdin instead, so a producer holding the candidate in a memfd
+// or shared memory object can skip the file system entirely.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BuggyOracleProtocol.h"
+
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+using namespace buggy_oracle;
+
+int main(int argc, char **argv) {
+  if (argc != 3) {
+    std::fprintf(stderr, "usage: %s <socket> <candidate>\n", argv[0]);
+    return OracleUnavailableExitCode;
+  }
+
+  const char *Socket = argv[1];
+  const char *Candidate = argv[2];
+  int CandidateFD = STDIN_FILENO;
+  if (std::strcmp(Candidate, "-") != 0)
+    CandidateFD = ::open(Candidate, O_RDONLY | O_CLOEXEC);
+  if (CandidateFD < 0) {
+    std::fprintf(stderr, "%s: %s: %s\n", argv[0], Candidate,
+                 std::strerror(errno));
+    return OracleUnavailableExitCode;
+  }
+
+  sockaddr_un Addr;
+  std::memset(&Addr, 0, sizeof(Addr));
+  Addr.sun_family = AF_UNIX;
+  if (std::strlen(Socket) >= sizeof(Addr.sun_path)) {
+    std::fprintf(stderr, "%s: socket path too long: %s\n", argv[0], Socket);
+    return OracleUnavailableExitCode;
+  }
+  std::strcpy(Addr.sun_path, Socket);
+
+  int Sock = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Sock < 0 ||
+      ::connect(Sock, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0) {
+    std::fprintf(stderr, "%s: cannot connect to oracle at %s: %s\n", argv[0],
+                 Socket, std::strerror(errno));
+    return OracleUnavailableExitCode;
+  }
+
+  const int Fds[NumPassedFds] = {CandidateFD, STDOUT_FILENO, STDERR_FILENO};
+  int32_t Status;
+  if (!sendRequest(Sock, Candidate, Fds) ||
+      !readAll(Sock, &Status, sizeof(Status)) || Status == -1) {
+    std::fprintf(stderr, "%s: no answer from oracle at %s\n", argv[0], Socket);
+    return OracleUnavailableExitCode;
+  }
+
+  if (WIFEXITED(Status))
+    return WEXITSTATUS(Status);
+  if (WIFSIGNALED(Status))
+    return 128 + WTERMSIG(Status);
+  return OracleUnavailableExitCode;
+}
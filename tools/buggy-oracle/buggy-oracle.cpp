@@ -0,0 +1,304 @@
+//===----------------------------------------------------------------------===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Persistent interestingness oracle. Loads pass plugins and parses the pass
+// pipeline once, then answers requests from buggy-oracle-client over a unix
+// socket. Every candidate runs in a forked copy of the warm server, so a
+// crashing or hanging pipeline behaves exactly as it would in a fresh opt
+// process, minus the process startup, plugin loading and pipeline setup.
+//
+// With --prefilter, bitcode candidates are first scanned for the records the
+// bugs enabled on the buggy pass need, and candidates that cannot hit any of
+// them are answered as passing without running the pipeline at all. The
+// pipeline then has to start with buggy, since an earlier pass could create
+// what a bug needs.
+//
+//===----------------------------------------------------------------------===//
+
+#include "BuggyOracleProtocol.h"
+#include "common/BuggyBitcodeFilter.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/Verifier.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Passes/PassBuilder.h"
+#include "llvm/Passes/PassPlugin.h"
+#include "llvm/Passes/StandardInstrumentations.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/InitLLVM.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/raw_ostream.h"
+
+#include <csignal>
+#include <optional>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+using namespace llvm;
+using namespace buggy_oracle;
+
+static cl::opt<std::string> SocketPath("socket",
+                                       cl::desc("Unix socket to listen on"),
+                                       cl::value_desc("path"), cl::Required);
+
+static cl::opt<std::string>
+    PassPipeline("passes", cl::desc("Pass pipeline to run on each candidate"),
+                 cl::Required);
+
+static cl::list<std::string>
+    PassPlugins("load-pass-plugin",
+                cl::desc("Load passes from plugin library"));
+
+static cl::opt<unsigned>
+    Timeout("timeout",
+            cl::desc("Kill the pipeline for a candidate after this many "
+                     "seconds (0 for no limit)"),
+            cl::init(0));
+
+static cl::opt<bool>
+    DisableVerify("disable-verify",
+                  cl::desc("Do not verify candidates before and after the "
+                           "pipeline"));
+
+static cl::opt<bool>
+    Prefilter("prefilter",
+              cl::desc("Answer bitcode candidates that cannot fail the buggy "
+                       "pass starting the pipeline without running it"));
+
+static const char *ToolName;
+
+namespace {
+/// Everything needed to run the pipeline. Built once before serving the first
+/// request and inherited by every forked worker.
+struct OracleState {
+  LLVMContext Ctx;
+  LoopAnalysisManager LAM;
+  FunctionAnalysisManager FAM;
+  CGSCCAnalysisManager CGAM;
+  ModuleAnalysisManager MAM;
+  PassInstrumentationCallbacks PIC;
+  StandardInstrumentations SI;
+  PassBuilder PB;
+  ModulePassManager MPM;
+  std::optional<buggy_prefilter::BitcodeFilter> Filter;
+
+  OracleState()
+      : SI(Ctx, /*DebugLogging=*/false),
+        PB(/*TM=*/nullptr, PipelineTuningOptions(), std::nullopt, &PIC) {}
+
+  Error init();
+};
+} // anonymous namespace
+
+Error OracleState::init() {
+  for (const std::string &PluginPath : PassPlugins) {
+    Expected<PassPlugin> Plugin = PassPlugin::Load(PluginPath);
+    if (!Plugin)
+      return Plugin.takeError();
+    Plugin->registerPassBuilderCallbacks(PB);
+  }
+
+  PB.registerModuleAnalyses(MAM);
+  PB.registerCGSCCAnalyses(CGAM);
+  PB.registerFunctionAnalyses(FAM);
+  PB.registerLoopAnalyses(LAM);
+  PB.crossRegisterProxies(LAM, FAM, CGAM, MAM);
+  SI.registerCallbacks(PIC, &MAM);
+
+  if (Error E = PB.parsePassPipeline(MPM, PassPipeline))
+    return E;
+  if (!DisableVerify)
+    MPM.addPass(VerifierPass());
+
+  if (Prefilter) {
+    Expected<buggy_prefilter::BitcodeFilter> F =
+        buggy_prefilter::BitcodeFilter::createForPipeline(PassPipeline);
+    if (!F)
+      return F.takeError();
+    Filter = std::move(*F);
+  }
+  return Error::success();
+}
+
+/// Map the candidate open on \p FD. Bitcode is parsed straight out of a view
+/// of the caller's file. Textual IR needs a null terminated buffer, which the
+/// mapping also provides unless the size is an exact multiple of the page
+/// size. Anything that cannot be mapped, such as a pipe, is read into memory.
+static ErrorOr<std::unique_ptr<MemoryBuffer>> mapCandidate(int FD,
+                                                        StringRef Name) {
+  unsigned char Magic[4];
+  bool IsBitcode = ::pread(FD, Magic, sizeof(Magic), 0) == sizeof(Magic) &&
+                   isBitcode(Magic, Magic + sizeof(Magic));
+  return MemoryBuffer::getOpenFile(sys::fs::convertFDToNativeFile(FD), Name,
+                                   /*FileSize=*/-1,
+                                   /*RequiresNullTerminator=*/!IsBitcode);
+}
+
+/// Parse and run the pipeline on one candidate, returning the exit code opt
+/// would have used.
+static int runCandidate(OracleState &S, MemoryBufferRef Buffer) {
+  StringRef Name = Buffer.getBufferIdentifier();
+  SMDiagnostic Err;
+  std::unique_ptr<Module> M = parseIR(Buffer, Err, S.Ctx);
+  if (!M) {
+    Err.print(ToolName, errs());
+    return 1;
+  }
+
+  if (!DisableVerify && verifyModule(*M, &errs())) {
+    errs() << ToolName << ": " << Name << ": error: input module is broken!\n";
+    return 1;
+  }
+
+  S.MPM.run(*M, S.MAM);
+  return 0;
+}
+
+static volatile pid_t RunnerPid = 0;
+
+static void killRunner(int) {
+  if (RunnerPid > 0)
+    ::kill(RunnerPid, SIGKILL);
+}
+
+/// Serve a single connection. Runs in its own process, so several candidates
+/// can be evaluated at once.
+static void handleConnection(OracleState &S, int Conn) {
+  std::string Name;
+  int Fds[NumPassedFds];
+  if (!receiveRequest(Conn, Name, Fds))
+    return;
+
+  // The server ignores SIGCHLD to reap connection handlers, but here the
+  // runner's status is the answer.
+  ::signal(SIGCHLD, SIG_DFL);
+
+  // Map the candidate before forking, so the prefilter and the runner share
+  // the mapping.
+  ErrorOr<std::unique_ptr<MemoryBuffer>> Buffer =
+      mapCandidate(Fds[CandidateFd], Name);
+  if (Buffer && S.Filter && !S.Filter->mayFail(**Buffer)) {
+    for (int FD : Fds)
+      ::close(FD);
+    int32_t Status = 0;
+    writeAll(Conn, &Status, sizeof(Status));
+    return;
+  }
+
+  pid_t Runner = ::fork();
+  if (Runner == 0) {
+    ::close(Conn);
+    ::dup2(Fds[StdoutFd], STDOUT_FILENO);
+    ::dup2(Fds[StderrFd], STDERR_FILENO);
+    ::close(Fds[StdoutFd]);
+    ::close(Fds[StderrFd]);
+
+    int Ret = 1;
+    if (Buffer)
+      Ret = runCandidate(S, **Buffer);
+    else
+      errs() << ToolName << ": " << Name << ": " << Buffer.getError().message()
+             << '\n';
+    outs().flush();
+    errs().flush();
+    ::_exit(Ret);
+  }
+
+  for (int FD : Fds)
+    ::close(FD);
+
+  int32_t Status = -1;
+  if (Runner > 0) {
+    RunnerPid = Runner;
+    if (Timeout != 0) {
+      struct sigaction SA;
+      std::memset(&SA, 0, sizeof(SA));
+      SA.sa_handler = killRunner;
+      ::sigaction(SIGALRM, &SA, nullptr);
+      ::alarm(Timeout);
+    }
+
+    int WaitStatus;
+    pid_t Waited;
+    do
+      Waited = ::waitpid(Runner, &WaitStatus, 0);
+    while (Waited < 0 && errno == EINTR);
+    if (Waited == Runner)
+      Status = WaitStatus;
+  }
+
+  writeAll(Conn, &Status, sizeof(Status));
+}
+
+static int serve(OracleState &S) {
+  sockaddr_un Addr;
+  std::memset(&Addr, 0, sizeof(Addr));
+  Addr.sun_family = AF_UNIX;
+  if (SocketPath.size() >= sizeof(Addr.sun_path)) {
+    errs() << ToolName << ": socket path too long: " << SocketPath << '\n';
+    return 1;
+  }
+  std::memcpy(Addr.sun_path, SocketPath.data(), SocketPath.size());
+
+  int Listen = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (Listen < 0) {
+    errs() << ToolName << ": socket: " << std::strerror(errno) << '\n';
+    return 1;
+  }
+
+  // A stale socket from an earlier run would make bind fail.
+  ::unlink(SocketPath.c_str());
+  if (::bind(Listen, reinterpret_cast<sockaddr *>(&Addr), sizeof(Addr)) < 0 ||
+      ::listen(Listen, SOMAXCONN) < 0) {
+    errs() << ToolName << ": cannot listen on " << SocketPath << ": "
+           << std::strerror(errno) << '\n';
+    return 1;
+  }
+
+  ::signal(SIGCHLD, SIG_IGN);
+  while (true) {
+    int Conn = ::accept(Listen, nullptr, nullptr);
+    if (Conn < 0) {
+      if (errno == EINTR || errno == ECONNABORTED)
+        continue;
+      errs() << ToolName << ": accept: " << std::strerror(errno) << '\n';
+      return 1;
+    }
+
+    pid_t Handler = ::fork();
+    if (Handler == 0) {
+      ::close(Listen);
+      handleConnection(S, Conn);
+      ::_exit(0);
+    }
+
+    if (Handler < 0)
+      errs() << ToolName << ": fork: " << std::strerror(errno) << '\n';
+    ::close(Conn);
+  }
+}
+
+int main(int argc, char **argv) {
+  InitLLVM X(argc, argv);
+  ToolName = argv[0];
+
+  cl::ParseCommandLineOptions(argc, argv, "buggy plugin interestingness oracle\n");
+
+  OracleState S;
+  if (Error E = S.init()) {
+    errs() << ToolName << ": " << toString(std::move(E)) << '\n';
+    return 1;
+  }
+
+  return serve(S);
+}
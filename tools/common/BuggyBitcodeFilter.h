@@ -0,0 +1,430 @@
+//===- BuggyBitcodeFilter.h - Reject candidates from the bitcode -*- C++ -*-===//
+//
+// Part of the LLVM Project, under the Apache License v2.0 with LLVM Exceptions.
+// See https://llvm.org/LICENSE.txt for license information.
+// SPDX-License-Identifier: Apache-2.0 WITH LLVM-exception
+//
+//===----------------------------------------------------------------------===//
+//
+// Decides from the record stream of a bitcode file, without building any IR,
+// whether the buggy pass could possibly fail on it with a given set of
+// options. Only the kinds of records present are looked at: an input with no
+// shufflevector records cannot hit crash-on-shufflevector, one with no vector
+// types cannot hit crash-on-vector, and so on. The answer is conservative, so
+// anything unusual or unreadable counts as possibly failing.
+//
+//===----------------------------------------------------------------------===//
+
+#ifndef BUGGY_TOOLS_BUGGYBITCODEFILTER_H
+#define BUGGY_TOOLS_BUGGYBITCODEFILTER_H
+
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/ADT/StringSwitch.h"
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/LLVMBitCodes.h"
+#include "llvm/Bitstream/BitstreamReader.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/MemoryBuffer.h"
+
+#include <optional>
+
+namespace buggy_prefilter {
+
+/// Facts about a bitcode file that a bug can need. A bug is possible only if
+/// everything it requires was seen.
+enum BitcodeFeature : unsigned {
+  HasShuffleVector = 1 << 0,
+  HasVectorType = 1 << 1,
+  HasAggregateType = 1 << 2,
+  HasPhi = 1 << 3,
+  HasSelect = 1 << 4,
+  HasOddSwitch = 1 << 5,
+  HasCall = 1 << 6,
+  HasLoad = 1 << 7,
+  HasStore = 1 << 8,
+  HasIntToPtrCast = 1 << 9,
+  HasConstantExpr = 1 << 10,
+  HasWeakGlobal = 1 << 11
+};
+
+class BitcodeFilter {
+  /// For each enabled bug, the features it requires. Empty if some enabled
+  /// bug cannot be ruled out from the bitcode.
+  llvm::SmallVector<unsigned, 4> Requirements;
+  bool AlwaysPossible = false;
+
+  /// Union of all requirements, to stop scanning once they have been seen.
+  unsigned Wanted = 0;
+
+  /// Marks an option that is not a bug at all.
+  static constexpr unsigned NotABug = ~0u;
+
+  /// The features each option of BuggyOptions.def needs, 0 if it cannot be
+  /// ruled out, or NotABug. Every option has to be listed, so a new one
+  /// cannot be left out by accident.
+  struct Requirement {
+    static constexpr unsigned CrashOnVector = HasVectorType;
+    static constexpr unsigned CrashOnShuffleVector = HasShuffleVector;
+    static constexpr unsigned CrashOnAggregatePhi = HasPhi | HasAggregateType;
+    static constexpr unsigned CrashOnPhiRepeatedPredecessor = HasPhi;
+    static constexpr unsigned CrashOnPhiSelfReference = HasPhi;
+    static constexpr unsigned CrashOnLoadOfIntToPtr = HasLoad | HasIntToPtrCast;
+    static constexpr unsigned CrashOnStoreToConstantExpr =
+        HasStore | HasConstantExpr;
+    static constexpr unsigned CrashOnSwitchOddNumberCases = HasOddSwitch;
+    static constexpr unsigned CrashOnI1Select = HasSelect;
+    static constexpr unsigned CrashIfWeakGlobalExists = HasWeakGlobal;
+    static constexpr unsigned InfLoopOnIndirectCall = HasCall;
+    static constexpr unsigned BugOnlyIfOddNumberInsts = NotABug;
+    static constexpr unsigned BugOnlyIfInternalFunc = NotABug;
+    static constexpr unsigned BugOnlyIfExternalFunc = NotABug;
+    static constexpr unsigned InsertUnparseableAsm = 0;
+    static constexpr unsigned MiscompileICmpSltToSle = 0;
+    static constexpr unsigned CrashOnBuggyAttr = 0;
+    static constexpr unsigned CrashOnBuggyGlobalState = 0;
+    static constexpr unsigned Probe = NotABug;
+    static constexpr unsigned DryRun = NotABug;
+    static constexpr unsigned ExitCode = NotABug;
+    static constexpr unsigned VerdictCache = NotABug;
+    static constexpr unsigned BuggyAttrModuleFlag = NotABug;
+  };
+
+  /// Return the features needed for bug option \p Name, 0 if the option
+  /// cannot be ruled out, or std::nullopt if it is not a bug at all.
+  static std::optional<unsigned> getRequirement(llvm::StringRef Name) {
+    unsigned Required = llvm::StringSwitch<unsigned>(Name)
+#define BUGGY_OPTION(Field, OptName) .Case(OptName, Requirement::Field)
+#include "BuggyOptions.def"
+                            .Default(NotABug);
+    if (Required == NotABug)
+      return std::nullopt;
+    return Required;
+  }
+
+  /// Scan the records of one block, and recursively the blocks of interest
+  /// nested in it, adding to \p Seen. Returns false if the stream could not
+  /// be understood.
+  bool scanBlock(llvm::BitstreamCursor &Stream, unsigned BlockID,
+                 unsigned &Seen, bool &UseStrtab,
+                 std::optional<llvm::BitstreamBlockInfo> &BlockInfo) const {
+    using namespace llvm;
+    SmallVector<uint64_t, 16> Record;
+    while (true) {
+      if ((Seen & Wanted) == Wanted)
+        return true;
+
+      Expected<BitstreamEntry> Entry = Stream.advance();
+      if (!Entry) {
+        consumeError(Entry.takeError());
+        return false;
+      }
+
+      switch (Entry->Kind) {
+      case BitstreamEntry::Error:
+        return false;
+      case BitstreamEntry::EndBlock:
+        return true;
+      case BitstreamEntry::SubBlock:
+        if (Entry->ID == bitc::BLOCKINFO_BLOCK_ID) {
+          Expected<std::optional<BitstreamBlockInfo>> Info =
+              Stream.ReadBlockInfoBlock();
+          if (!Info) {
+            consumeError(Info.takeError());
+            return false;
+          }
+          if (!*Info)
+            return false;
+          BlockInfo = std::move(*Info);
+          Stream.setBlockInfo(&*BlockInfo);
+          continue;
+        }
+
+        if (Entry->ID == bitc::MODULE_BLOCK_ID ||
+            Entry->ID == bitc::TYPE_BLOCK_ID_NEW ||
+            Entry->ID == bitc::CONSTANTS_BLOCK_ID ||
+            Entry->ID == bitc::FUNCTION_BLOCK_ID) {
+          if (Error E = Stream.EnterSubBlock(Entry->ID)) {
+            consumeError(std::move(E));
+            return false;
+          }
+          if (!scanBlock(Stream, Entry->ID, Seen, UseStrtab, BlockInfo))
+            return false;
+          continue;
+        }
+
+        if (Error E = Stream.SkipBlock()) {
+          consumeError(std::move(E));
+          return false;
+        }
+        continue;
+      case BitstreamEntry::Record:
+        break;
+      }
+
+      Record.clear();
+      Expected<unsigned> Code = Stream.readRecord(Entry->ID, Record);
+      if (!Code) {
+        consumeError(Code.takeError());
+        return false;
+      }
+      Seen |= getFeatures(BlockID, *Code, Record, UseStrtab);
+    }
+  }
+
+  static unsigned getFeatures(unsigned BlockID, unsigned Code,
+                              llvm::ArrayRef<uint64_t> Record,
+                              bool &UseStrtab) {
+    using namespace llvm;
+    switch (BlockID) {
+    case bitc::MODULE_BLOCK_ID:
+      if (Code == bitc::MODULE_CODE_VERSION && !Record.empty())
+        UseStrtab = Record[0] >= 2;
+      if (Code == bitc::MODULE_CODE_GLOBALVAR ||
+          Code == bitc::MODULE_CODE_FUNCTION ||
+          Code == bitc::MODULE_CODE_ALIAS || Code == bitc::MODULE_CODE_IFUNC) {
+        // Every global value record starts with [strtab offset, strtab size]?
+        // followed by three fields and the linkage.
+        size_t LinkageIdx = UseStrtab ? 5 : 3;
+        if (Record.size() <= LinkageIdx)
+          return HasWeakGlobal;
+        // The old and new encodings of weak and weak_odr linkage.
+        switch (Record[LinkageIdx]) {
+        case 1:
+        case 10:
+        case 16:
+        case 17:
+          return HasWeakGlobal;
+        }
+      }
+      return 0;
+    case bitc::TYPE_BLOCK_ID_NEW:
+      switch (Code) {
+      case bitc::TYPE_CODE_VECTOR:
+        return HasVectorType;
+      case bitc::TYPE_CODE_ARRAY:
+      case bitc::TYPE_CODE_STRUCT_ANON:
+      case bitc::TYPE_CODE_STRUCT_NAMED:
+      case bitc::TYPE_CODE_OPAQUE:
+        return HasAggregateType;
+      }
+      return 0;
+    case bitc::CONSTANTS_BLOCK_ID:
+      switch (Code) {
+      case bitc::CST_CODE_SETTYPE:
+      case bitc::CST_CODE_NULL:
+      case bitc::CST_CODE_UNDEF:
+      case bitc::CST_CODE_POISON:
+      case bitc::CST_CODE_INTEGER:
+      case bitc::CST_CODE_WIDE_INTEGER:
+      case bitc::CST_CODE_FLOAT:
+      case bitc::CST_CODE_AGGREGATE:
+      case bitc::CST_CODE_STRING:
+      case bitc::CST_CODE_CSTRING:
+      case bitc::CST_CODE_DATA:
+        return 0;
+      }
+      // Everything else is, or might be, a constant expression.
+      return HasConstantExpr;
+    case bitc::FUNCTION_BLOCK_ID:
+      switch (Code) {
+      case bitc::FUNC_CODE_INST_SHUFFLEVEC:
+        return HasShuffleVector;
+      case bitc::FUNC_CODE_INST_PHI:
+        return HasPhi;
+      case bitc::FUNC_CODE_INST_SELECT:
+      case bitc::FUNC_CODE_INST_VSELECT:
+        return HasSelect;
+      case bitc::FUNC_CODE_INST_SWITCH:
+        // [opty, cond, default, (value, dest) x N], unless it is one of the
+        // old encodings tagged with 0x4B5 in the upper bits.
+        if (Record.empty() || (Record[0] >> 16) == 0x4B5 ||
+            Record.size() < 3)
+          return HasOddSwitch;
+        return (((Record.size() - 3) / 2) & 1) ? HasOddSwitch : 0;
+      case bitc::FUNC_CODE_INST_CALL:
+      case bitc::FUNC_CODE_INST_INVOKE:
+      case bitc::FUNC_CODE_INST_CALLBR:
+        return HasCall;
+      case bitc::FUNC_CODE_INST_LOAD:
+      case bitc::FUNC_CODE_INST_LOADATOMIC:
+        return HasLoad;
+      case bitc::FUNC_CODE_INST_STORE:
+      case bitc::FUNC_CODE_INST_STOREATOMIC:
+      case bitc::FUNC_CODE_INST_STORE_OLD:
+      case bitc::FUNC_CODE_INST_STOREATOMIC_OLD:
+        return HasStore;
+      case bitc::FUNC_CODE_INST_CAST:
+        // [opval, opty?, destty, castopc, flags?]. Depending on whether the
+        // operand is a forward reference the opcode is the third or fourth
+        // field, so accept either.
+        if ((Record.size() > 2 && Record[2] == bitc::CAST_INTTOPTR) ||
+            (Record.size() > 3 && Record[3] == bitc::CAST_INTTOPTR))
+          return HasIntToPtrCast;
+        return 0;
+      }
+      return 0;
+    }
+    return 0;
+  }
+
+public:
+  /// Build a filter for the buggy pass parameters \p Options, in the syntax
+  /// of buggy<...> and BUGGY_PLUGIN_OPTS.
+  static llvm::Expected<BitcodeFilter> create(llvm::StringRef Options) {
+    BitcodeFilter Filter;
+    while (!Options.empty()) {
+      llvm::StringRef Name;
+      std::tie(Name, Options) = Options.split(';');
+      if (Name.empty() || Name.contains('=') || Name.starts_with("no-"))
+        continue;
+
+      bool Known = llvm::StringSwitch<bool>(Name)
+#define BUGGY_OPTION(Field, OptName) .Case(OptName, true)
+#include "BuggyOptions.def"
+                       .Default(false);
+      if (!Known) {
+        return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                       "invalid buggy pass parameter '%s'",
+                                       Name.str().c_str());
+      }
+
+      std::optional<unsigned> Required = getRequirement(Name);
+      if (!Required)
+        continue;
+      if (*Required == 0)
+        Filter.AlwaysPossible = true;
+      Filter.Requirements.push_back(*Required);
+      Filter.Wanted |= *Required;
+    }
+    return Filter;
+  }
+
+  /// Build a filter for the buggy pass running first in \p Pipeline. The
+  /// filter only judges the input, while an earlier pass could create what a
+  /// bug needs (simplifycfg turns PHIs into selects, say). So the pipeline is
+  /// refused unless its first pass, inside any adaptors and after any
+  /// require<> or invalidate<>, is buggy or buggy-parallel, and no later pass
+  /// is either of them.
+  static llvm::Expected<BitcodeFilter>
+  createForPipeline(llvm::StringRef Pipeline) {
+    struct PipelinePass {
+      llvm::StringRef Name;
+      llvm::StringRef Params;
+      bool Adaptor;
+    };
+
+    auto Invalid = [&](const char *Reason) {
+      return llvm::createStringError(llvm::inconvertibleErrorCode(),
+                                     "cannot prefilter pipeline '%s': %s",
+                                     Pipeline.str().c_str(), Reason);
+    };
+
+    llvm::SmallVector<PipelinePass, 8> Passes;
+    size_t Pos = 0;
+    while (Pos < Pipeline.size()) {
+      size_t Start = Pos;
+      while (Pos < Pipeline.size() &&
+             !llvm::StringRef(",()<").contains(Pipeline[Pos]))
+        ++Pos;
+      llvm::StringRef Name = Pipeline.slice(Start, Pos).trim();
+
+      llvm::StringRef Params;
+      if (Pos < Pipeline.size() && Pipeline[Pos] == '<') {
+        size_t ParamsStart = ++Pos;
+        unsigned Depth = 1;
+        for (; Pos < Pipeline.size() && Depth != 0; ++Pos) {
+          if (Pipeline[Pos] == '<')
+            ++Depth;
+          else if (Pipeline[Pos] == '>')
+            --Depth;
+        }
+        if (Depth != 0)
+          return Invalid("unbalanced '<'");
+        Params = Pipeline.slice(ParamsStart, Pos - 1);
+      }
+
+      bool Adaptor = Pos < Pipeline.size() && Pipeline[Pos] == '(';
+      if (!Name.empty())
+        Passes.push_back({Name, Params, Adaptor});
+      while (Pos < Pipeline.size() &&
+             llvm::StringRef(",()").contains(Pipeline[Pos]))
+        ++Pos;
+    }
+
+    const PipelinePass *First = nullptr;
+    for (const PipelinePass &P : Passes) {
+      if (P.Adaptor)
+        continue;
+      bool IsBuggy = P.Name == "buggy" || P.Name == "buggy-parallel";
+      if (First) {
+        if (IsBuggy)
+          return Invalid("buggy runs more than once");
+        continue;
+      }
+      if (IsBuggy)
+        First = &P;
+      else if (P.Name != "require" && P.Name != "invalidate")
+        return Invalid("it does not start with buggy");
+    }
+    if (!First)
+      return Invalid("it does not start with buggy");
+    return create(First->Params);
+  }
+
+  /// Return false only if no enabled bug can fire on the bitcode in
+  /// \p Buffer. Inputs that are not bitcode are always accepted.
+  bool mayFail(llvm::MemoryBufferRef Buffer) const {
+    using namespace llvm;
+    if (AlwaysPossible || Requirements.empty())
+      return AlwaysPossible;
+
+    const unsigned char *Start =
+        reinterpret_cast<const unsigned char *>(Buffer.getBufferStart());
+    const unsigned char *End = Start + Buffer.getBufferSize();
+    if (!isBitcode(Start, End))
+      return true;
+    if (isBitcodeWrapper(Start, End) &&
+        SkipBitcodeWrapperHeader(Start, End, /*VerifyBufferSize=*/true))
+      return true;
+
+    // isBitcode already checked the magic number.
+    BitstreamCursor Stream(ArrayRef<uint8_t>(Start, End));
+    if (Error E = Stream.JumpToBit(32)) {
+      consumeError(std::move(E));
+      return true;
+    }
+
+    unsigned Seen = 0;
+    bool UseStrtab = false;
+    std::optional<BitstreamBlockInfo> BlockInfo;
+    while (!Stream.AtEndOfStream() && (Seen & Wanted) != Wanted) {
+      Expected<BitstreamEntry> Entry = Stream.advance();
+      if (!Entry) {
+        consumeError(Entry.takeError());
+        return true;
+      }
+      if (Entry->Kind != BitstreamEntry::SubBlock)
+        return true;
+
+      Error E = Entry->ID == bitc::MODULE_BLOCK_ID
+                    ? Stream.EnterSubBlock(Entry->ID)
+                    : Stream.SkipBlock();
+      if (E) {
+        consumeError(std::move(E));
+        return true;
+      }
+      if (Entry->ID == bitc::MODULE_BLOCK_ID &&
+          !scanBlock(Stream, Entry->ID, Seen, UseStrtab, BlockInfo))
+        return true;
+    }
+
+    return any_of(Requirements, [&](unsigned Required) {
+      return (Seen & Required) == Required;
+    });
+  }
+};
+
+} // namespace buggy_prefilter
+
+#endif // BUGGY_TOOLS_BUGGYBITCODEFILTER_H